@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "nvs.h"
+#include "cJSON.h"
+#include "logger.hpp"
+#include "database.hpp"
+
+// Suites run against the namespaces they use, which are dropped first, so the app must not be flashed on a unit
+// whose database is in use. On the linux target the database is a file in BOW_DATABASE_DIRECTORY.
+// Entity components depend on the unit drivers (gpio, ledc, hardware SHA, i2c clock and wifi), which the linux
+// target does not provide, so the controller listing, codec and rows suites only run on a unit. The trigger listing
+// is not measured anywhere, as its controller starts a scheduler that needs the clock and transmitter.
+namespace bench
+{
+    static const char *TAG = "bench";
+
+    static const char *LOAD_NAMESPACE = "bench_load";
+    static const uint32_t LOAD_RECORDS = 10000;
+    static const uint32_t LOAD_READS = 1000;
+    static const uint32_t LOAD_PAGE_LIMIT = 50;
+
+    static const uint32_t SCALE_SIZES[] = {10, 50, 100, 500, 1000, 5000}; // Records per namespace
+    static const uint32_t SCALE_OPERATIONS = 100;                        // Of each single-record operation, per size
+    static const uint32_t SCALE_SCANS = 5;                               // Of each whole-namespace operation, per size
+    static const uint32_t SCALE_BATCH_SIZE = 16;                         // Records written per batch when filling
+    static const uint32_t SCALE_PAGE_LIMIT = 50;
+
+    static const uint32_t CODEC_RUNS = 1000; // Per record and direction
+
+    static const uint32_t ROWS_RECORDS = 100;
+    static const float ROWS_MAX_ALLOCATIONS = 0.5f; // Per row built in a result set, chunks of its arena included
+
+    void Key(uint32_t i, char key[NVS_KEY_NAME_MAX_SIZE]);
+    // Device record, keyed by its name
+    cJSON *Record(uint32_t i, char key[NVS_KEY_NAME_MAX_SIZE]);
+    int64_t Elapsed(int64_t start); // Microseconds
+    void Report(logger::Logger *logger, const char *suite, uint32_t size, const char *name,
+                const database::OperationStats *stats);
+
+    void Load(logger::Logger *logger, database::Database *database);
+    void Scale(logger::Logger *logger, database::Database *database);
+#if !CONFIG_IDF_TARGET_LINUX
+    void ScaleLists(logger::Logger *logger, database::Database *database); // Users, devices and roles
+    void Codec(logger::Logger *logger);
+    bool Rows(logger::Logger *logger); // Whether listed rows are built without allocating each field
+#endif
+}
\ No newline at end of file
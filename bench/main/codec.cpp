@@ -0,0 +1,129 @@
+#include "sdkconfig.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "nvs.h"
+#include "cJSON.h"
+#include "logger.hpp"
+#include "database.hpp"
+#include "user.hpp"
+#include "device.hpp"
+#include "trigger.hpp"
+#include "role.hpp"
+#include "provisioner.hpp"
+#include "bench.hpp"
+
+namespace bench
+{
+    // NVS spans strings and blobs over 32-byte entries after a header one, and blobs take an index entry too
+    static uint32_t stringEntries(size_t size)
+    {
+        return 1 + (size + 31) / 32;
+    }
+
+    static uint32_t blobEntries(size_t size)
+    {
+        return 2 + (size + 31) / 32;
+    }
+
+    // Both ways a record can be stored, as JSON text and as a binary record of its schema
+    static void measureCodec(logger::Logger *logger, const char *name, const database::Schema *schema, cJSON *record)
+    {
+        int64_t start;
+        uint32_t allocations;
+
+        start = esp_timer_get_time();
+        allocations = database::Allocations::Count();
+        for (uint32_t i = 0; i < CODEC_RUNS; i++)
+            cJSON_free(cJSON_PrintUnformatted(record));
+        int64_t textEncode = Elapsed(start);
+        uint32_t textEncodeAllocations = database::Allocations::Count() - allocations;
+
+        char *text = cJSON_PrintUnformatted(record);
+        size_t textSize = strlen(text) + 1;
+
+        start = esp_timer_get_time();
+        allocations = database::Allocations::Count();
+        for (uint32_t i = 0; i < CODEC_RUNS; i++)
+            cJSON_Delete(cJSON_Parse(text));
+        int64_t textDecode = Elapsed(start);
+        uint32_t textDecodeAllocations = database::Allocations::Count() - allocations;
+
+        uint8_t *data;
+        size_t dataSize;
+
+        start = esp_timer_get_time();
+        allocations = database::Allocations::Count();
+        for (uint32_t i = 0; i < CODEC_RUNS; i++)
+        {
+            ESP_ERROR_CHECK(schema->Encode(record, &data, &dataSize));
+            free((void *)data);
+        }
+        int64_t binaryEncode = Elapsed(start);
+        uint32_t binaryEncodeAllocations = database::Allocations::Count() - allocations;
+
+        ESP_ERROR_CHECK(schema->Encode(record, &data, &dataSize));
+
+        start = esp_timer_get_time();
+        allocations = database::Allocations::Count();
+        for (uint32_t i = 0; i < CODEC_RUNS; i++)
+        {
+            cJSON *decoded = NULL;
+            ESP_ERROR_CHECK(schema->Decode(data, dataSize, &decoded));
+            cJSON_Delete(decoded);
+        }
+        int64_t binaryDecode = Elapsed(start);
+        uint32_t binaryDecodeAllocations = database::Allocations::Count() - allocations;
+
+        logger->Info(TAG, "codec: %s text bytes=%zu entries=%" PRIu32 " encode=%.2f us decode=%.2f us allocations=%.1f/%.1f",
+                     name, textSize, stringEntries(textSize),
+                     (float)textEncode / CODEC_RUNS, (float)textDecode / CODEC_RUNS,
+                     (float)textEncodeAllocations / CODEC_RUNS, (float)textDecodeAllocations / CODEC_RUNS);
+        logger->Info(TAG, "codec: %s binary bytes=%zu entries=%" PRIu32 " encode=%.2f us decode=%.2f us allocations=%.1f/%.1f",
+                     name, dataSize, blobEntries(dataSize),
+                     (float)binaryEncode / CODEC_RUNS, (float)binaryDecode / CODEC_RUNS,
+                     (float)binaryEncodeAllocations / CODEC_RUNS, (float)binaryDecodeAllocations / CODEC_RUNS);
+
+        free((void *)data);
+        cJSON_free(text);
+    }
+
+    void Codec(logger::Logger *logger)
+    {
+        char key[NVS_KEY_NAME_MAX_SIZE];
+        cJSON *record;
+
+        user::User user("user00000000", "9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08", "",
+                        "Admin", "🙂", 1700000000);
+        record = user.JSON();
+        measureCodec(logger, "user", &user::DB_SCHEMA, record);
+        cJSON_Delete(record);
+
+        record = Record(0, key);
+        measureCodec(logger, "device", &device::DB_SCHEMA, record);
+        cJSON_Delete(record);
+
+        trigger::Trigger trigger("trigger00000000", key, "0 7 * * 1-5", "⏰", "Admin", 1700000000);
+        record = trigger.JSON();
+        measureCodec(logger, "trigger", &trigger::DB_SCHEMA, record);
+        cJSON_Delete(record);
+
+        const char *devices[] = {"device00000000", "device00000001", "device00000002", NULL};
+        role::Role role("role00000000", devices, "🔑", "Admin", 1700000000);
+        record = role.JSON();
+        measureCodec(logger, "role", &role::DB_SCHEMA, record);
+        cJSON_Delete(record);
+
+        provisioner::Credentials credentials("Diana", "correct horse battery staple",
+                                             {"192.168.1.50", "255.255.255.0", "192.168.1.1"});
+        record = credentials.JSON();
+        measureCodec(logger, "credentials", &provisioner::DB_SCHEMA, record);
+        cJSON_Delete(record);
+    }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,92 @@
+#include "sdkconfig.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "esp_timer.h"
+#include "nvs.h"
+#include "cJSON.h"
+#include "logger.hpp"
+#include "database.hpp"
+#include "user.hpp"
+#include "device.hpp"
+#include "role.hpp"
+#include "bench.hpp"
+
+namespace bench
+{
+    // Whole listings as the list endpoints build them, including the release of the result set
+    template <typename T, typename C>
+    static void measureList(logger::Logger *logger, const char *name, uint32_t size, C *controller)
+    {
+        int64_t total = 0;
+        uint64_t allocations = 0;
+        uint32_t rows = 0;
+
+        for (uint32_t i = 0; i < SCALE_SCANS; i++)
+        {
+            int64_t start = esp_timer_get_time();
+            uint32_t before = database::Allocations::Count();
+            {
+                database::ResultSet<T> list;
+                controller->List(&list);
+                rows = list.Size();
+            }
+            allocations += database::Allocations::Count() - before;
+            total += Elapsed(start);
+        }
+
+        logger->Info(TAG, "lists: n=%" PRIu32 " %s rows=%" PRIu32 " mean=%" PRId64 " us allocations/row=%.2f",
+                     size, name, rows, total / SCALE_SCANS, rows > 0 ? (float)allocations / SCALE_SCANS / rows : 0.0f);
+    }
+
+    // Each controller List as its namespace grows, except the trigger one, see bench.hpp
+    void ScaleLists(logger::Logger *logger, database::Database *database)
+    {
+        char key[NVS_KEY_NAME_MAX_SIZE];
+        char name[NVS_KEY_NAME_MAX_SIZE];
+
+        user::Controller *users = user::Controller::New(logger, database);
+        device::Controller *devices = device::Controller::New(logger, database);
+        role::Controller *roles = role::Controller::New(logger, database, devices);
+        users->Drop();
+        devices->Drop();
+        roles->Drop();
+
+        uint32_t filled = 0;
+        for (int s = 0; s < sizeof(SCALE_SIZES) / sizeof(uint32_t); s++)
+        {
+            uint32_t size = SCALE_SIZES[s];
+
+            // Grow every namespace up to the size, roles after the devices they include
+            for (uint32_t i = filled; i < size; i++)
+            {
+                cJSON *deviceJSON = Record(i, key);
+                device::Device device(deviceJSON);
+                devices->Set(&device);
+                cJSON_Delete(deviceJSON);
+
+                snprintf(name, NVS_KEY_NAME_MAX_SIZE, "user%08" PRIx32, i);
+                user::User user(name, "0123456789abcdef", "", "Admin", "🙂", 1700000000 + i);
+                users->Set(&user);
+
+                snprintf(name, NVS_KEY_NAME_MAX_SIZE, "role%08" PRIx32, i);
+                const char *included[] = {key, NULL};
+                role::Role role(name, included, "🔑", "Admin", 1700000000 + i);
+                roles->Set(&role);
+            }
+            filled = size;
+
+            measureList<user::User>(logger, "users", size, users);
+            measureList<device::Device>(logger, "devices", size, devices);
+            measureList<role::Role>(logger, "roles", size, roles);
+        }
+
+        users->Drop();
+        devices->Drop();
+        roles->Drop();
+    }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include "esp_timer.h"
+#include "nvs.h"
+#include "cJSON.h"
+#include "logger.hpp"
+#include "database.hpp"
+#include "bench.hpp"
+
+namespace bench
+{
+    // Fills a namespace the way a large unit would be, so whole-namespace paths can be profiled with perf on a host
+    void Load(logger::Logger *logger, database::Database *database)
+    {
+        char key[NVS_KEY_NAME_MAX_SIZE];
+        int64_t start;
+
+        database::Handle *handle = database->Open(LOAD_NAMESPACE);
+        ESP_ERROR_CHECK(handle->Drop());
+
+        // Write every record on its own, as controllers do
+        start = esp_timer_get_time();
+        for (uint32_t i = 0; i < LOAD_RECORDS; i++)
+        {
+            cJSON *record = Record(i, key);
+            ESP_ERROR_CHECK(handle->Set(key, record));
+            cJSON_Delete(record);
+        }
+        logger->Info(TAG, "load: %" PRIu32 " sets in %" PRId64 " ms", LOAD_RECORDS, Elapsed(start) / 1000);
+
+        uint32_t count;
+        start = esp_timer_get_time();
+        ESP_ERROR_CHECK(handle->Count(&count));
+        logger->Info(TAG, "load: count of %" PRIu32 " in %" PRId64 " us", count, Elapsed(start));
+
+        start = esp_timer_get_time();
+        for (uint32_t i = 0; i < LOAD_READS; i++)
+        {
+            cJSON *record = NULL;
+            Key(rand() % LOAD_RECORDS, key);
+            ESP_ERROR_CHECK(handle->Get(key, &record));
+            cJSON_Delete(record);
+        }
+        logger->Info(TAG, "load: %" PRIu32 " random gets in %" PRId64 " ms", LOAD_READS, Elapsed(start) / 1000);
+
+        uint32_t scanned = 0;
+        start = esp_timer_get_time();
+        ESP_ERROR_CHECK(handle->Scan(
+            [](const char *key, cJSON *record, void *context) -> bool
+            {
+                (*(uint32_t *)context)++;
+                return false;
+            },
+            &scanned));
+        logger->Info(TAG, "load: full scan of %" PRIu32 " in %" PRId64 " ms", scanned, Elapsed(start) / 1000);
+
+        // Every page walks the whole namespace, so paging through it is quadratic in the number of pages
+        uint32_t pages = 0;
+        database::Cursor cursor;
+        start = esp_timer_get_time();
+        do
+        {
+            ESP_ERROR_CHECK(handle->Scan(
+                [](const char *key, cJSON *record, void *context) -> bool
+                { return false; },
+                NULL, LOAD_PAGE_LIMIT, &cursor));
+            pages++;
+        } while (cursor.More);
+        logger->Info(TAG, "load: %" PRIu32 " pages of %" PRIu32 " in %" PRId64 " ms", pages, LOAD_PAGE_LIMIT, Elapsed(start) / 1000);
+
+        database::HandleStats stats;
+        handle->GetStats(&stats);
+        logger->Info(TAG, "load: %zu NVS entries used, %.1f per record", stats.Entries, (float)stats.Entries / LOAD_RECORDS);
+
+        ESP_ERROR_CHECK(handle->Drop());
+    }
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "sdkconfig.h"
+#include "esp_timer.h"
+#include "cJSON.h"
+#include "logger.hpp"
+#include "database.hpp"
+#include "bench.hpp"
+
+namespace bench
+{
+    void Key(uint32_t i, char key[NVS_KEY_NAME_MAX_SIZE])
+    {
+        snprintf(key, NVS_KEY_NAME_MAX_SIZE, "device%08" PRIx32, i);
+    }
+
+    cJSON *Record(uint32_t i, char key[NVS_KEY_NAME_MAX_SIZE])
+    {
+        Key(i, key);
+
+        cJSON *record = cJSON_CreateObject();
+        cJSON_AddStringToObject(record, "name", key);
+        cJSON_AddStringToObject(record, "type", "ACTUATOR");
+        cJSON_AddStringToObject(record, "subtype", "BUTTON");
+        cJSON_AddNumberToObject(record, "protocol", 1);
+        cJSON *context = cJSON_AddObjectToObject(record, "context");
+        cJSON_AddStringToObject(context, "command", "0x5A3C1E");
+        cJSON_AddStringToObject(context, "emoji", "🔘");
+        cJSON_AddStringToObject(record, "emoji", "💡");
+        cJSON_AddStringToObject(record, "creator", "Admin");
+        cJSON_AddNumberToObject(record, "created_at", 1700000000 + i);
+
+        return record;
+    }
+
+    int64_t Elapsed(int64_t start)
+    {
+        return esp_timer_get_time() - start;
+    }
+
+    void Report(logger::Logger *logger, const char *suite, uint32_t size, const char *name,
+                const database::OperationStats *stats)
+    {
+        logger->Info(TAG, "%s: n=%" PRIu32 " %s calls=%" PRIu32 " p50=%" PRIu32 " p90=%" PRIu32 " p99=%" PRIu32
+                          " max=%" PRIu32 " us allocations=%.1f",
+                     suite, size, name, stats->Calls, stats->Percentile(50), stats->Percentile(90), stats->Percentile(99),
+                     stats->Max, stats->Calls > 0 ? (float)stats->Allocations / stats->Calls : 0.0f);
+    }
+}
+
+extern "C" void app_main(void)
+{
+    logger::Logger *logger = logger::Logger::New(ESP_LOG_INFO);
+    database::Database *database = database::Database::New(logger);
+
+    bench::Load(logger, database);
+    bench::Scale(logger, database);
+#if !CONFIG_IDF_TARGET_LINUX
+    bench::ScaleLists(logger, database);
+    bench::Codec(logger);
+    if (!bench::Rows(logger))
+        logger->Error(bench::TAG, "rows: listed entities allocate more than expected");
+#endif
+
+#if CONFIG_IDF_TARGET_LINUX
+    // The host app is a process, which ends with the suites
+    exit(0);
+#endif
+}
\ No newline at end of file
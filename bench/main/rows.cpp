@@ -0,0 +1,106 @@
+#include "sdkconfig.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "nvs.h"
+#include "cJSON.h"
+#include "logger.hpp"
+#include "database.hpp"
+#include "user.hpp"
+#include "device.hpp"
+#include "trigger.hpp"
+#include "role.hpp"
+#include "bench.hpp"
+
+namespace bench
+{
+    // Allocations per row of an entity built on its own, as listings did, and in a result set, as they do now.
+    // Returns whether the result set needs fewer and the records were left untouched.
+    template <typename T>
+    static bool measureRows(logger::Logger *logger, const char *name, cJSON *records[ROWS_RECORDS])
+    {
+        uint32_t allocations;
+
+        allocations = database::Allocations::Count();
+        for (uint32_t i = 0; i < ROWS_RECORDS; i++)
+        {
+            T item(records[i]);
+        }
+        float copied = (float)(database::Allocations::Count() - allocations) / ROWS_RECORDS;
+
+        allocations = database::Allocations::Count();
+        {
+            database::ResultSet<T> items;
+            items.Reserve(ROWS_RECORDS);
+            for (uint32_t i = 0; i < ROWS_RECORDS; i++)
+                items.Add(records[i]);
+        }
+        float arena = (float)(database::Allocations::Count() - allocations) / ROWS_RECORDS;
+
+        // Building entities must not take the strings of the records they are built from
+        bool untouched = true;
+        for (uint32_t i = 0; i < ROWS_RECORDS; i++)
+            if (cJSON_GetStringValue(cJSON_GetObjectItem(records[i], "name")) == NULL)
+                untouched = false;
+
+        bool passed = untouched && arena < copied && arena <= ROWS_MAX_ALLOCATIONS;
+        logger->Level(passed ? ESP_LOG_INFO : ESP_LOG_ERROR, TAG,
+                      "rows: %s %s copied=%.2f arena=%.2f allocations/row%s",
+                      passed ? "PASS" : "FAIL", name, copied, arena, untouched ? "" : ", records were modified");
+
+        return passed;
+    }
+
+    bool Rows(logger::Logger *logger)
+    {
+        char key[NVS_KEY_NAME_MAX_SIZE];
+        char name[NVS_KEY_NAME_MAX_SIZE];
+        cJSON *records[ROWS_RECORDS];
+        bool passed = true;
+
+        for (uint32_t i = 0; i < ROWS_RECORDS; i++)
+        {
+            snprintf(name, NVS_KEY_NAME_MAX_SIZE, "user%08" PRIx32, i);
+            user::User user(name, "0123456789abcdef", "", "Admin", "🙂", 1700000000 + i);
+            records[i] = user.JSON();
+        }
+        passed = measureRows<user::User>(logger, "users", records) && passed;
+        for (uint32_t i = 0; i < ROWS_RECORDS; i++)
+            cJSON_Delete(records[i]);
+
+        for (uint32_t i = 0; i < ROWS_RECORDS; i++)
+            records[i] = Record(i, key);
+        passed = measureRows<device::Device>(logger, "devices", records) && passed;
+        for (uint32_t i = 0; i < ROWS_RECORDS; i++)
+            cJSON_Delete(records[i]);
+
+        for (uint32_t i = 0; i < ROWS_RECORDS; i++)
+        {
+            snprintf(name, NVS_KEY_NAME_MAX_SIZE, "trigger%08" PRIx32, i);
+            Key(i, key);
+            trigger::Trigger trigger(name, key, "0 7 * * 1-5", "⏰", "Admin", 1700000000 + i);
+            records[i] = trigger.JSON();
+        }
+        passed = measureRows<trigger::Trigger>(logger, "triggers", records) && passed;
+        for (uint32_t i = 0; i < ROWS_RECORDS; i++)
+            cJSON_Delete(records[i]);
+
+        for (uint32_t i = 0; i < ROWS_RECORDS; i++)
+        {
+            snprintf(name, NVS_KEY_NAME_MAX_SIZE, "role%08" PRIx32, i);
+            Key(i, key);
+            const char *devices[] = {key, NULL};
+            role::Role role(name, devices, "🔑", "Admin", 1700000000 + i);
+            records[i] = role.JSON();
+        }
+        passed = measureRows<role::Role>(logger, "roles", records) && passed;
+        for (uint32_t i = 0; i < ROWS_RECORDS; i++)
+            cJSON_Delete(records[i]);
+
+        return passed;
+    }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,99 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "nvs.h"
+#include "cJSON.h"
+#include "logger.hpp"
+#include "database.hpp"
+#include "bench.hpp"
+
+namespace bench
+{
+    static const char *OPERATION_NAMES[database::OPERATION_MAX] = {"get", "set", "delete", "count", "find", "scan"};
+
+    // Operations of a namespace as it grows, reported from the handle profiler so the numbers match the ones of a unit
+    void Scale(logger::Logger *logger, database::Database *database)
+    {
+        char key[NVS_KEY_NAME_MAX_SIZE];
+        char nmspace[NVS_KEY_NAME_MAX_SIZE];
+
+        for (int s = 0; s < sizeof(SCALE_SIZES) / sizeof(uint32_t); s++)
+        {
+            uint32_t size = SCALE_SIZES[s];
+
+            // A handle of its own per size, so its stats only hold the operations of that size
+            snprintf(nmspace, NVS_KEY_NAME_MAX_SIZE, "bench_s%" PRIu32, size);
+            database::Handle *handle = database->Open(nmspace);
+            ESP_ERROR_CHECK(handle->Drop());
+
+            // Fill it in batches, which are not profiled
+            database::WriteBatch batch;
+            for (uint32_t i = 0; i < size; i++)
+            {
+                cJSON *record = Record(i, key);
+                batch.Set(handle, key, record);
+                cJSON_Delete(record);
+
+                if ((i + 1) % SCALE_BATCH_SIZE == 0 || i + 1 == size)
+                    ESP_ERROR_CHECK(batch.Commit());
+            }
+
+            database::HandleStats stats;
+            handle->GetStats(&stats);
+            logger->Info(TAG, "scale: n=%" PRIu32 " entries=%zu", size, stats.Entries);
+
+            for (uint32_t i = 0; i < SCALE_OPERATIONS; i++)
+            {
+                cJSON *record = NULL;
+                Key(rand() % size, key);
+                ESP_ERROR_CHECK(handle->Get(key, &record));
+                cJSON_Delete(record);
+            }
+
+            for (uint32_t i = 0; i < SCALE_OPERATIONS; i++)
+            {
+                cJSON *record = Record(rand() % size, key);
+                ESP_ERROR_CHECK(handle->Set(key, record));
+                cJSON_Delete(record);
+            }
+
+            for (uint32_t i = 0; i < SCALE_OPERATIONS; i++)
+            {
+                uint32_t count;
+                ESP_ERROR_CHECK(handle->Count(&count));
+            }
+
+            for (uint32_t i = 0; i < SCALE_SCANS; i++)
+            {
+                ESP_ERROR_CHECK(handle->Find(
+                    [](const char *key, void *context) -> bool
+                    { return false; },
+                    NULL));
+
+                ESP_ERROR_CHECK(handle->Scan(
+                    [](const char *key, cJSON *record, void *context) -> bool
+                    { return false; },
+                    NULL));
+
+                database::Cursor cursor;
+                ESP_ERROR_CHECK(handle->Scan(
+                    [](const char *key, cJSON *record, void *context) -> bool
+                    { return false; },
+                    NULL, SCALE_PAGE_LIMIT, &cursor));
+            }
+
+            // Deleted last, as they shrink the namespace
+            for (uint32_t i = 0; i < SCALE_OPERATIONS && i < size; i++)
+            {
+                Key(i, key);
+                ESP_ERROR_CHECK(handle->Delete(key));
+            }
+
+            handle->GetStats(&stats);
+            for (int i = 0; i < database::OPERATION_MAX; i++)
+                Report(logger, "scale", size, OPERATION_NAMES[i], &stats.Operations[i]);
+
+            ESP_ERROR_CHECK(handle->Drop());
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,64 @@
+#include "sdkconfig.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_attr.h"
+#include "database.hpp"
+
+namespace database
+{
+    // Tasks only own their thread-local storage once the scheduler runs, so nothing is counted before
+    static bool tracking = false;
+    static thread_local uint32_t allocations = 0;
+
+    void Allocations::Track()
+    {
+        tracking = true;
+    }
+
+    uint32_t Allocations::Count()
+    {
+        return allocations;
+    }
+
+    static inline IRAM_ATTR void countAllocation()
+    {
+        if (tracking)
+            allocations++;
+    }
+}
+
+#if CONFIG_DATABASE_PROFILE && CONFIG_IDF_TARGET_LINUX
+
+// The C library allocator is wrapped, strings duplicated by it included
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+extern "C" void *malloc(size_t size)
+{
+    database::countAllocation();
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    database::countAllocation();
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    database::countAllocation();
+    return __libc_realloc(ptr, size);
+}
+
+#elif CONFIG_DATABASE_PROFILE && CONFIG_HEAP_USE_HOOKS
+
+// Called by the heap on every allocation, including the ones made by newlib and cJSON
+extern "C" IRAM_ATTR void esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+{
+    database::countAllocation();
+}
+
+#endif
\ No newline at end of file
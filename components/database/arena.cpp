@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "cJSON.h"
+#include "database.hpp"
+
+namespace database
+{
+    Arena::Arena(bool external)
+    {
+        this->chunks = NULL;
+        this->external = external;
+    }
+
+    size_t Arena::header()
+    {
+        // The header is padded so chunk data stays aligned
+        return (sizeof(Chunk) + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+    }
+
+    Arena::~Arena()
+    {
+        while (this->chunks != NULL)
+        {
+            Chunk *chunk = this->chunks;
+            this->chunks = chunk->Next;
+            free((void *)chunk);
+        }
+    }
+
+    void *Arena::Allocate(size_t size)
+    {
+        // Keep every allocation suitably aligned for any type
+        size = (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+
+        Chunk *chunk = this->chunks;
+        if (chunk == NULL || chunk->Size - chunk->Used < size)
+        {
+            size_t chunkSize = chunk != NULL ? chunk->Size * 2 : ARENA_CHUNK_SIZE;
+            while (chunkSize < size)
+                chunkSize *= 2;
+
+            if (this->external)
+                chunk = (Chunk *)heap_caps_malloc_prefer(header() + chunkSize, 2, MALLOC_CAP_SPIRAM, MALLOC_CAP_DEFAULT);
+            else
+                chunk = (Chunk *)malloc(header() + chunkSize);
+            if (chunk == NULL)
+                ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+
+            chunk->Size = header() + chunkSize;
+            chunk->Used = header();
+            chunk->Next = this->chunks;
+            this->chunks = chunk;
+        }
+
+        void *ptr = (uint8_t *)chunk + chunk->Used;
+        chunk->Used += size;
+
+        return ptr;
+    }
+
+    void Arena::Reset()
+    {
+        if (this->chunks == NULL)
+            return;
+
+        // Chunks only grow, so the most recent one is the largest
+        while (this->chunks->Next != NULL)
+        {
+            Chunk *chunk = this->chunks->Next;
+            this->chunks->Next = chunk->Next;
+            free((void *)chunk);
+        }
+
+        this->chunks->Used = header();
+    }
+
+    char *Arena::Copy(Arena *arena, const char *str)
+    {
+        if (arena == NULL)
+            return strdup(str);
+
+        size_t size = strlen(str) + 1;
+        char *copy = (char *)arena->Allocate(size);
+        memcpy(copy, str, size);
+
+        return copy;
+    }
+
+    char *Arena::Copy(Arena *arena, cJSON *item)
+    {
+        if (item == NULL || item->valuestring == NULL)
+            return NULL;
+
+        return Copy(arena, item->valuestring);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "esp_err.h"
+#include "nvs.h"
+
+namespace database
+{
+    // Storage the database is built on, selected at build time: NVS on targets and a memory-mapped
+    // file emulating NVS on Linux (CONFIG_IDF_TARGET_LINUX), so storage-heavy code can be profiled on hosts.
+    // Functions, types and errors follow the NVS API they replace.
+    namespace backend
+    {
+        // Backend specific
+        typedef struct Iterator *iterator_t;
+
+        esp_err_t Init(const char *partition);
+        esp_err_t Deinit(const char *partition);
+        esp_err_t Erase(const char *partition);
+        esp_err_t Stats(const char *partition, nvs_stats_t *stats);
+
+        esp_err_t Open(const char *partition, const char *nmspace, nvs_handle_t *handle);
+        void Close(nvs_handle_t handle);
+        esp_err_t Commit(nvs_handle_t handle);
+
+        esp_err_t GetU8(nvs_handle_t handle, const char *key, uint8_t *value);
+        esp_err_t SetU8(nvs_handle_t handle, const char *key, uint8_t value);
+        esp_err_t GetStr(nvs_handle_t handle, const char *key, char *value, size_t *length);
+        esp_err_t SetStr(nvs_handle_t handle, const char *key, const char *value);
+        esp_err_t GetBlob(nvs_handle_t handle, const char *key, void *value, size_t *length);
+        esp_err_t SetBlob(nvs_handle_t handle, const char *key, const void *value, size_t length);
+        esp_err_t FindKey(nvs_handle_t handle, const char *key, nvs_type_t *type);
+        esp_err_t EraseKey(nvs_handle_t handle, const char *key);
+        esp_err_t EraseAll(nvs_handle_t handle);
+        esp_err_t UsedEntries(nvs_handle_t handle, size_t *entries);
+
+        esp_err_t EntryFind(const char *partition, const char *nmspace, nvs_type_t type, iterator_t *iterator);
+        esp_err_t EntryNext(iterator_t *iterator);
+        esp_err_t EntryInfo(iterator_t iterator, nvs_entry_info_t *info);
+        void ReleaseIterator(iterator_t iterator);
+    }
+}
\ No newline at end of file
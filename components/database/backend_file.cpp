@@ -0,0 +1,899 @@
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "esp_err.h"
+#include "nvs.h"
+#include "backend.hpp"
+#include "database.hpp"
+
+namespace database
+{
+    namespace backend
+    {
+        static const uint32_t FILE_MAGIC = 0x776F6264;                   // "dbow"
+        static const uint32_t FILE_VERSION = 1;                          // File layout version
+        static const size_t FILE_PARTITION_SIZE = 5 * 1024 * 1024;       // Bytes, as the database partition
+        static const size_t FILE_PAGE_SIZE = 4096;                       // Bytes, as flash sectors
+        static const size_t FILE_PAGE_ENTRIES = 126;                     // As NVS pages
+        static const size_t FILE_ENTRY_SIZE = 32;                        // Bytes, as NVS entries
+        static const char *FILE_DIRECTORY_ENV = "BOW_DATABASE_DIRECTORY"; // Defaults to the working directory
+        static const uint8_t FILE_NAMESPACES = 0;                        // Namespace of the namespace entries
+        static const uint8_t FILE_FREE = 0xFF;                           // Namespace of the free entries
+        static const uint8_t FILE_MAX_HANDLES = 32;
+        static const uint32_t FILE_KEY_BUCKETS = 4096; // Of the in-memory key index of each partition
+
+        // Same size and accounting as NVS entries: one header plus as many entries as the data spans
+        class Entry
+        {
+        public:
+            uint8_t Namespace;
+            uint8_t Type;
+            uint16_t Span; // Entries, including the header
+            uint32_t Size; // Bytes of data, stored in the next entries for strings and blobs
+            char Key[NVS_KEY_NAME_MAX_SIZE];
+            uint8_t Data[8]; // Inline data for integers
+        };
+
+        class Header
+        {
+        public:
+            uint32_t Magic;
+            uint32_t Version;
+            uint32_t Entries;
+            uint8_t Reserved[FILE_ENTRY_SIZE - 3 * sizeof(uint32_t)];
+        };
+
+        // Header entry of a stored key, chained in the bucket of its namespace and key
+        class Slot
+        {
+        public:
+            uint32_t Index;
+            Slot *Next;
+        };
+
+        // Run of consecutive free entries
+        class Span
+        {
+        public:
+            uint32_t Start;
+            uint32_t Length;
+            Span *Next;
+        };
+
+        // The file only stores the entries, they are looked up and allocated through indexes built at mount
+        class Mount
+        {
+        public:
+            char Name[NVS_KEY_NAME_MAX_SIZE];
+            int File;
+            uint8_t *Map;
+            size_t Size; // Bytes
+            Header *Head;
+            Entry *Entries;
+            Slot *Keys[FILE_KEY_BUCKETS];
+            Span *Free;                                        // Sorted by start, adjacent runs are merged
+            uint32_t Used;                                     // Entries
+            uint32_t Usage[FILE_FREE];                         // Entries, per namespace index
+            char Namespaces[FILE_FREE][NVS_KEY_NAME_MAX_SIZE]; // Names, per namespace index
+            uint8_t LastNamespace;
+            Mount *Next;
+        };
+
+        class Handle
+        {
+        public:
+            Mount *Partition;
+            uint8_t Namespace;
+        };
+
+        class Iterator
+        {
+        public:
+            Mount *Partition;
+            uint8_t Namespace;
+            nvs_type_t Type;
+            uint32_t Index;
+        };
+
+        static_assert(sizeof(Entry) == FILE_ENTRY_SIZE);
+        static_assert(sizeof(Header) == FILE_ENTRY_SIZE);
+
+        static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+        static Mount *partitions = NULL;
+        static Handle handles[FILE_MAX_HANDLES] = {};
+
+        static Mount *findPartition(const char *name)
+        {
+            for (Mount *partition = partitions; partition != NULL; partition = partition->Next)
+                if (!strcmp(partition->Name, name))
+                    return partition;
+
+            return NULL;
+        }
+
+        static Handle *getHandle(nvs_handle_t handle)
+        {
+            if (handle < 1 || handle > FILE_MAX_HANDLES || handles[handle - 1].Partition == NULL)
+                return NULL;
+
+            return &handles[handle - 1];
+        }
+
+        static bool matches(const Entry *entry, uint8_t nmspace, nvs_type_t type)
+        {
+            return entry->Namespace == nmspace && (type == NVS_TYPE_ANY || entry->Type == type);
+        }
+
+        static Slot **findSlot(Mount *partition, uint8_t nmspace, const char *key)
+        {
+            Slot **link = &partition->Keys[(Pool::Hash(key) + nmspace) % FILE_KEY_BUCKETS];
+            while (*link != NULL)
+            {
+                Entry *entry = &partition->Entries[(*link)->Index];
+                if (entry->Namespace == nmspace && !strncmp(entry->Key, key, NVS_KEY_NAME_MAX_SIZE))
+                    break;
+                link = &(*link)->Next;
+            }
+
+            return link;
+        }
+
+        // Returns the index of the key header entry or -1, and ESP_ERR_NVS_TYPE_MISMATCH as NVS does
+        static int32_t findEntry(Mount *partition, uint8_t nmspace, const char *key, nvs_type_t type, esp_err_t *err)
+        {
+            Slot *slot = *findSlot(partition, nmspace, key);
+            if (slot == NULL)
+            {
+                *err = ESP_ERR_NVS_NOT_FOUND;
+                return -1;
+            }
+
+            Entry *entry = &partition->Entries[slot->Index];
+            *err = type == NVS_TYPE_ANY || entry->Type == type ? ESP_OK : ESP_ERR_NVS_TYPE_MISMATCH;
+
+            return slot->Index;
+        }
+
+        // Accounts the written entry at index and makes its key findable
+        static void indexEntry(Mount *partition, uint32_t index)
+        {
+            Entry *entry = &partition->Entries[index];
+
+            Slot **link = findSlot(partition, entry->Namespace, entry->Key);
+            *link = new Slot();
+            (*link)->Index = index;
+            (*link)->Next = NULL;
+
+            partition->Used += entry->Span;
+            partition->Usage[entry->Namespace] += entry->Span;
+
+            if (entry->Namespace == FILE_NAMESPACES)
+            {
+                strncpy(partition->Namespaces[entry->Data[0]], entry->Key, NVS_KEY_NAME_MAX_SIZE);
+                if (entry->Data[0] > partition->LastNamespace)
+                    partition->LastNamespace = entry->Data[0];
+            }
+        }
+
+        // Inserts a run of free entries, merging it with the adjacent ones
+        static void releaseEntries(Mount *partition, uint32_t start, uint32_t length)
+        {
+            Span *previous = NULL;
+            Span **link = &partition->Free;
+            while (*link != NULL && (*link)->Start < start)
+            {
+                previous = *link;
+                link = &(*link)->Next;
+            }
+
+            Span *next = *link;
+            if (previous != NULL && previous->Start + previous->Length == start)
+            {
+                previous->Length += length;
+                if (next != NULL && previous->Start + previous->Length == next->Start)
+                {
+                    previous->Length += next->Length;
+                    previous->Next = next->Next;
+                    delete next;
+                }
+                return;
+            }
+
+            if (next != NULL && start + length == next->Start)
+            {
+                next->Start = start;
+                next->Length += length;
+                return;
+            }
+
+            Span *span = new Span();
+            span->Start = start;
+            span->Length = length;
+            span->Next = next;
+            *link = span;
+        }
+
+        // First fit of span consecutive free entries
+        static int32_t allocateEntries(Mount *partition, uint16_t span)
+        {
+            for (Span **link = &partition->Free; *link != NULL; link = &(*link)->Next)
+            {
+                Span *run = *link;
+                if (run->Length < span)
+                    continue;
+
+                uint32_t index = run->Start;
+                run->Start += span;
+                run->Length -= span;
+                if (run->Length == 0)
+                {
+                    *link = run->Next;
+                    delete run;
+                }
+
+                return index;
+            }
+
+            return -1;
+        }
+
+        static void freeEntries(Mount *partition, uint32_t index)
+        {
+            Entry *entry = &partition->Entries[index];
+            uint16_t span = entry->Span;
+
+            Slot **link = findSlot(partition, entry->Namespace, entry->Key);
+            Slot *slot = *link;
+            *link = slot->Next;
+            delete slot;
+
+            partition->Used -= span;
+            partition->Usage[entry->Namespace] -= span;
+
+            memset(entry, 0xFF, span * FILE_ENTRY_SIZE);
+            releaseEntries(partition, index, span);
+        }
+
+        // Builds the indexes from the entries of a mounted file
+        static void load(Mount *partition)
+        {
+            for (uint32_t i = 0; i < partition->Head->Entries;)
+            {
+                Entry *entry = &partition->Entries[i];
+                if (entry->Namespace != FILE_FREE)
+                {
+                    indexEntry(partition, i);
+                    i += entry->Span;
+                    continue;
+                }
+
+                uint32_t start = i;
+                while (i < partition->Head->Entries && partition->Entries[i].Namespace == FILE_FREE)
+                    i++;
+                releaseEntries(partition, start, i - start);
+            }
+        }
+
+        static void unload(Mount *partition)
+        {
+            for (uint32_t i = 0; i < FILE_KEY_BUCKETS; i++)
+            {
+                while (partition->Keys[i] != NULL)
+                {
+                    Slot *slot = partition->Keys[i];
+                    partition->Keys[i] = slot->Next;
+                    delete slot;
+                }
+            }
+
+            while (partition->Free != NULL)
+            {
+                Span *span = partition->Free;
+                partition->Free = span->Next;
+                delete span;
+            }
+        }
+
+        static int32_t findNamespace(Mount *partition, const char *nmspace)
+        {
+            esp_err_t err;
+
+            int32_t index = findEntry(partition, FILE_NAMESPACES, nmspace, NVS_TYPE_U8, &err);
+            if (index < 0)
+                return -1;
+
+            return partition->Entries[index].Data[0];
+        }
+
+        static esp_err_t write(nvs_handle_t handle, const char *key, nvs_type_t type, const void *value, size_t size)
+        {
+            esp_err_t err;
+
+            Handle *h = getHandle(handle);
+            if (h == NULL)
+                return ESP_ERR_NVS_INVALID_HANDLE;
+
+            if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE)
+                return ESP_ERR_NVS_KEY_TOO_LONG;
+
+            int32_t old = findEntry(h->Partition, h->Namespace, key, type, &err);
+            if (err == ESP_ERR_NVS_TYPE_MISMATCH)
+                return err;
+
+            bool inlined = type != NVS_TYPE_STR && type != NVS_TYPE_BLOB;
+            uint16_t span = 1 + (inlined ? 0 : (size + FILE_ENTRY_SIZE - 1) / FILE_ENTRY_SIZE);
+
+            // As NVS, the new entry is written before the old one is erased
+            int32_t index = allocateEntries(h->Partition, span);
+            if (index < 0)
+                return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+
+            Entry *entry = &h->Partition->Entries[index];
+            memset(entry, 0xFF, span * FILE_ENTRY_SIZE);
+            entry->Namespace = h->Namespace;
+            entry->Type = type;
+            entry->Span = span;
+            entry->Size = size;
+            strncpy(entry->Key, key, NVS_KEY_NAME_MAX_SIZE);
+            memcpy(inlined ? entry->Data : (uint8_t *)(entry + 1), value, size);
+
+            if (old >= 0)
+                freeEntries(h->Partition, old);
+            indexEntry(h->Partition, index);
+
+            return ESP_OK;
+        }
+
+        static esp_err_t read(nvs_handle_t handle, const char *key, nvs_type_t type, void *value, size_t *size)
+        {
+            esp_err_t err;
+
+            Handle *h = getHandle(handle);
+            if (h == NULL)
+                return ESP_ERR_NVS_INVALID_HANDLE;
+
+            int32_t index = findEntry(h->Partition, h->Namespace, key, type, &err);
+            if (err != ESP_OK)
+                return err;
+
+            Entry *entry = &h->Partition->Entries[index];
+            bool inlined = type != NVS_TYPE_STR && type != NVS_TYPE_BLOB;
+
+            // Querying the size
+            if (value == NULL)
+            {
+                *size = entry->Size;
+                return ESP_OK;
+            }
+
+            if (*size < entry->Size)
+            {
+                *size = entry->Size;
+                return ESP_ERR_NVS_INVALID_LENGTH;
+            }
+
+            *size = entry->Size;
+            memcpy(value, inlined ? entry->Data : (uint8_t *)(entry + 1), entry->Size);
+
+            return ESP_OK;
+        }
+
+        esp_err_t Init(const char *partition)
+        {
+            pthread_mutex_lock(&lock);
+
+            if (findPartition(partition) != NULL)
+            {
+                pthread_mutex_unlock(&lock);
+                return ESP_OK;
+            }
+
+            const char *directory = getenv(FILE_DIRECTORY_ENV);
+            char path[256];
+            snprintf(path, sizeof(path), "%s/%s.bin", directory != NULL ? directory : ".", partition);
+
+            Mount *p = new Mount();
+            strncpy(p->Name, partition, NVS_KEY_NAME_MAX_SIZE - 1);
+            p->Name[NVS_KEY_NAME_MAX_SIZE - 1] = '\0';
+
+            uint32_t entries = (FILE_PARTITION_SIZE / FILE_PAGE_SIZE) * FILE_PAGE_ENTRIES;
+            p->Size = sizeof(Header) + entries * FILE_ENTRY_SIZE;
+
+            p->File = open(path, O_RDWR | O_CREAT, 0644);
+            if (p->File < 0)
+            {
+                delete p;
+                pthread_mutex_unlock(&lock);
+                return ESP_ERR_NVS_PART_NOT_FOUND;
+            }
+
+            off_t size = lseek(p->File, 0, SEEK_END);
+            if ((size != 0 && size != (off_t)p->Size) || ftruncate(p->File, p->Size) != 0)
+            {
+                close(p->File);
+                delete p;
+                pthread_mutex_unlock(&lock);
+                return ESP_ERR_NVS_NO_FREE_PAGES;
+            }
+
+            p->Map = (uint8_t *)mmap(NULL, p->Size, PROT_READ | PROT_WRITE, MAP_SHARED, p->File, 0);
+            if (p->Map == MAP_FAILED)
+            {
+                close(p->File);
+                delete p;
+                pthread_mutex_unlock(&lock);
+                return ESP_ERR_NO_MEM;
+            }
+
+            p->Head = (Header *)p->Map;
+            p->Entries = (Entry *)(p->Map + sizeof(Header));
+
+            // Format new files, other files are reported as unrecognized so they get erased
+            esp_err_t err = ESP_OK;
+            if (size == 0)
+            {
+                memset(p->Map, 0xFF, p->Size);
+                p->Head->Magic = FILE_MAGIC;
+                p->Head->Version = FILE_VERSION;
+                p->Head->Entries = entries;
+            }
+            else if (p->Head->Magic != FILE_MAGIC || p->Head->Entries != entries)
+                err = ESP_ERR_NVS_NO_FREE_PAGES;
+            else if (p->Head->Version != FILE_VERSION)
+                err = ESP_ERR_NVS_NEW_VERSION_FOUND;
+
+            if (err != ESP_OK)
+            {
+                munmap(p->Map, p->Size);
+                close(p->File);
+                delete p;
+                pthread_mutex_unlock(&lock);
+                return err;
+            }
+
+            load(p);
+
+            p->Next = partitions;
+            partitions = p;
+
+            pthread_mutex_unlock(&lock);
+
+            return ESP_OK;
+        }
+
+        esp_err_t Deinit(const char *partition)
+        {
+            pthread_mutex_lock(&lock);
+
+            Mount **link = &partitions;
+            while (*link != NULL && strcmp((*link)->Name, partition))
+                link = &(*link)->Next;
+
+            if (*link == NULL)
+            {
+                pthread_mutex_unlock(&lock);
+                return ESP_ERR_NVS_NOT_INITIALIZED;
+            }
+
+            Mount *p = *link;
+            *link = p->Next;
+
+            // Handles of the partition become invalid, as with NVS
+            for (uint8_t i = 0; i < FILE_MAX_HANDLES; i++)
+                if (handles[i].Partition == p)
+                    handles[i].Partition = NULL;
+
+            unload(p);
+            msync(p->Map, p->Size, MS_SYNC);
+            munmap(p->Map, p->Size);
+            close(p->File);
+            delete p;
+
+            pthread_mutex_unlock(&lock);
+
+            return ESP_OK;
+        }
+
+        esp_err_t Erase(const char *partition)
+        {
+            const char *directory = getenv(FILE_DIRECTORY_ENV);
+            char path[256];
+            snprintf(path, sizeof(path), "%s/%s.bin", directory != NULL ? directory : ".", partition);
+
+            pthread_mutex_lock(&lock);
+
+            // Mounted partitions cannot be erased
+            if (findPartition(partition) != NULL)
+            {
+                pthread_mutex_unlock(&lock);
+                return ESP_ERR_NVS_INVALID_STATE;
+            }
+
+            // Formatted again on the next init
+            int file = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+            pthread_mutex_unlock(&lock);
+
+            if (file < 0)
+                return ESP_ERR_NVS_PART_NOT_FOUND;
+
+            close(file);
+
+            return ESP_OK;
+        }
+
+        esp_err_t Stats(const char *partition, nvs_stats_t *stats)
+        {
+            pthread_mutex_lock(&lock);
+
+            Mount *p = findPartition(partition);
+            if (p == NULL)
+            {
+                pthread_mutex_unlock(&lock);
+                return ESP_ERR_NVS_NOT_INITIALIZED;
+            }
+
+            memset(stats, 0, sizeof(nvs_stats_t));
+            stats->total_entries = p->Head->Entries;
+            stats->used_entries = p->Used;
+            stats->free_entries = p->Head->Entries - p->Used;
+            stats->available_entries = stats->free_entries;
+            stats->namespace_count = p->Usage[FILE_NAMESPACES];
+
+            pthread_mutex_unlock(&lock);
+
+            return ESP_OK;
+        }
+
+        esp_err_t Open(const char *partition, const char *nmspace, nvs_handle_t *handle)
+        {
+            pthread_mutex_lock(&lock);
+
+            Mount *p = findPartition(partition);
+            if (p == NULL)
+            {
+                pthread_mutex_unlock(&lock);
+                return ESP_ERR_NVS_NOT_INITIALIZED;
+            }
+
+            if (strlen(nmspace) >= NVS_KEY_NAME_MAX_SIZE)
+            {
+                pthread_mutex_unlock(&lock);
+                return ESP_ERR_NVS_KEY_TOO_LONG;
+            }
+
+            // Register the namespace on first use, indexes start after the one of the namespace entries
+            int32_t index = findNamespace(p, nmspace);
+            if (index < 0)
+            {
+                index = p->LastNamespace + 1;
+
+                int32_t entry = index < FILE_FREE ? allocateEntries(p, 1) : -1;
+                if (entry < 0)
+                {
+                    pthread_mutex_unlock(&lock);
+                    return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+                }
+
+                memset(&p->Entries[entry], 0xFF, FILE_ENTRY_SIZE);
+                p->Entries[entry].Namespace = FILE_NAMESPACES;
+                p->Entries[entry].Type = NVS_TYPE_U8;
+                p->Entries[entry].Span = 1;
+                p->Entries[entry].Size = sizeof(uint8_t);
+                strncpy(p->Entries[entry].Key, nmspace, NVS_KEY_NAME_MAX_SIZE);
+                p->Entries[entry].Data[0] = index;
+                indexEntry(p, entry);
+            }
+
+            uint8_t i = 0;
+            while (i < FILE_MAX_HANDLES && handles[i].Partition != NULL)
+                i++;
+
+            if (i == FILE_MAX_HANDLES)
+            {
+                pthread_mutex_unlock(&lock);
+                return ESP_ERR_NVS_INVALID_HANDLE;
+            }
+
+            handles[i].Partition = p;
+            handles[i].Namespace = index;
+            *handle = i + 1;
+
+            pthread_mutex_unlock(&lock);
+
+            return ESP_OK;
+        }
+
+        void Close(nvs_handle_t handle)
+        {
+            pthread_mutex_lock(&lock);
+
+            Handle *h = getHandle(handle);
+            if (h != NULL)
+                h->Partition = NULL;
+
+            pthread_mutex_unlock(&lock);
+        }
+
+        esp_err_t Commit(nvs_handle_t handle)
+        {
+            pthread_mutex_lock(&lock);
+
+            Handle *h = getHandle(handle);
+            if (h == NULL)
+            {
+                pthread_mutex_unlock(&lock);
+                return ESP_ERR_NVS_INVALID_HANDLE;
+            }
+
+            // Writes already landed in the mapping, schedule them without blocking as flash commits do not either
+            msync(h->Partition->Map, h->Partition->Size, MS_ASYNC);
+
+            pthread_mutex_unlock(&lock);
+
+            return ESP_OK;
+        }
+
+        esp_err_t GetU8(nvs_handle_t handle, const char *key, uint8_t *value)
+        {
+            size_t size = sizeof(uint8_t);
+
+            pthread_mutex_lock(&lock);
+            esp_err_t err = read(handle, key, NVS_TYPE_U8, value, &size);
+            pthread_mutex_unlock(&lock);
+
+            return err;
+        }
+
+        esp_err_t SetU8(nvs_handle_t handle, const char *key, uint8_t value)
+        {
+            pthread_mutex_lock(&lock);
+            esp_err_t err = write(handle, key, NVS_TYPE_U8, &value, sizeof(uint8_t));
+            pthread_mutex_unlock(&lock);
+
+            return err;
+        }
+
+        esp_err_t GetStr(nvs_handle_t handle, const char *key, char *value, size_t *length)
+        {
+            pthread_mutex_lock(&lock);
+            esp_err_t err = read(handle, key, NVS_TYPE_STR, value, length);
+            pthread_mutex_unlock(&lock);
+
+            return err;
+        }
+
+        esp_err_t SetStr(nvs_handle_t handle, const char *key, const char *value)
+        {
+            pthread_mutex_lock(&lock);
+            esp_err_t err = write(handle, key, NVS_TYPE_STR, value, strlen(value) + 1);
+            pthread_mutex_unlock(&lock);
+
+            return err;
+        }
+
+        esp_err_t GetBlob(nvs_handle_t handle, const char *key, void *value, size_t *length)
+        {
+            pthread_mutex_lock(&lock);
+            esp_err_t err = read(handle, key, NVS_TYPE_BLOB, value, length);
+            pthread_mutex_unlock(&lock);
+
+            return err;
+        }
+
+        esp_err_t SetBlob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+        {
+            pthread_mutex_lock(&lock);
+            esp_err_t err = write(handle, key, NVS_TYPE_BLOB, value, length);
+            pthread_mutex_unlock(&lock);
+
+            return err;
+        }
+
+        esp_err_t FindKey(nvs_handle_t handle, const char *key, nvs_type_t *type)
+        {
+            esp_err_t err;
+
+            pthread_mutex_lock(&lock);
+
+            Handle *h = getHandle(handle);
+            if (h == NULL)
+            {
+                pthread_mutex_unlock(&lock);
+                return ESP_ERR_NVS_INVALID_HANDLE;
+            }
+
+            int32_t index = findEntry(h->Partition, h->Namespace, key, NVS_TYPE_ANY, &err);
+            if (index >= 0 && type != NULL)
+                *type = (nvs_type_t)h->Partition->Entries[index].Type;
+
+            pthread_mutex_unlock(&lock);
+
+            return err;
+        }
+
+        esp_err_t EraseKey(nvs_handle_t handle, const char *key)
+        {
+            esp_err_t err;
+
+            pthread_mutex_lock(&lock);
+
+            Handle *h = getHandle(handle);
+            if (h == NULL)
+            {
+                pthread_mutex_unlock(&lock);
+                return ESP_ERR_NVS_INVALID_HANDLE;
+            }
+
+            int32_t index = findEntry(h->Partition, h->Namespace, key, NVS_TYPE_ANY, &err);
+            if (index >= 0)
+                freeEntries(h->Partition, index);
+
+            pthread_mutex_unlock(&lock);
+
+            return err;
+        }
+
+        esp_err_t EraseAll(nvs_handle_t handle)
+        {
+            pthread_mutex_lock(&lock);
+
+            Handle *h = getHandle(handle);
+            if (h == NULL)
+            {
+                pthread_mutex_unlock(&lock);
+                return ESP_ERR_NVS_INVALID_HANDLE;
+            }
+
+            for (uint32_t i = 0; i < FILE_KEY_BUCKETS; i++)
+            {
+                // Freeing an entry unlinks its slot, which moves the next one in its place
+                Slot **link = &h->Partition->Keys[i];
+                while (*link != NULL)
+                {
+                    if (h->Partition->Entries[(*link)->Index].Namespace == h->Namespace)
+                        freeEntries(h->Partition, (*link)->Index);
+                    else
+                        link = &(*link)->Next;
+                }
+            }
+
+            pthread_mutex_unlock(&lock);
+
+            return ESP_OK;
+        }
+
+        esp_err_t UsedEntries(nvs_handle_t handle, size_t *entries)
+        {
+            pthread_mutex_lock(&lock);
+
+            Handle *h = getHandle(handle);
+            if (h == NULL)
+            {
+                pthread_mutex_unlock(&lock);
+                return ESP_ERR_NVS_INVALID_HANDLE;
+            }
+
+            *entries = h->Partition->Usage[h->Namespace];
+
+            pthread_mutex_unlock(&lock);
+
+            return ESP_OK;
+        }
+
+        // Moves the iterator to the first matching entry from its index, releasing it when there are none
+        static esp_err_t seek(iterator_t *iterator)
+        {
+            Iterator *iter = *iterator;
+            Mount *p = iter->Partition;
+
+            while (iter->Index < p->Head->Entries)
+            {
+                Entry *entry = &p->Entries[iter->Index];
+                if (matches(entry, iter->Namespace, iter->Type))
+                    return ESP_OK;
+
+                if (entry->Namespace != FILE_FREE)
+                {
+                    iter->Index += entry->Span;
+                    continue;
+                }
+
+                // Free runs are skipped whole
+                Span *run = p->Free;
+                while (run != NULL && run->Start + run->Length <= iter->Index)
+                    run = run->Next;
+                iter->Index = run != NULL ? run->Start + run->Length : iter->Index + 1;
+            }
+
+            delete iter;
+            *iterator = NULL;
+
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+
+        esp_err_t EntryFind(const char *partition, const char *nmspace, nvs_type_t type, iterator_t *iterator)
+        {
+            pthread_mutex_lock(&lock);
+
+            *iterator = NULL;
+
+            Mount *p = findPartition(partition);
+            if (p == NULL)
+            {
+                pthread_mutex_unlock(&lock);
+                return ESP_ERR_NVS_NOT_INITIALIZED;
+            }
+
+            int32_t index = findNamespace(p, nmspace);
+            if (index < 0)
+            {
+                pthread_mutex_unlock(&lock);
+                return ESP_ERR_NVS_NOT_FOUND;
+            }
+
+            Iterator *iter = new Iterator();
+            iter->Partition = p;
+            iter->Namespace = index;
+            iter->Type = type;
+            iter->Index = 0;
+            *iterator = iter;
+
+            esp_err_t err = seek(iterator);
+
+            pthread_mutex_unlock(&lock);
+
+            return err;
+        }
+
+        esp_err_t EntryNext(iterator_t *iterator)
+        {
+            if (*iterator == NULL)
+                return ESP_ERR_INVALID_ARG;
+
+            pthread_mutex_lock(&lock);
+
+            (*iterator)->Index += (*iterator)->Partition->Entries[(*iterator)->Index].Span;
+            esp_err_t err = seek(iterator);
+
+            pthread_mutex_unlock(&lock);
+
+            return err;
+        }
+
+        esp_err_t EntryInfo(iterator_t iterator, nvs_entry_info_t *info)
+        {
+            if (iterator == NULL)
+                return ESP_ERR_INVALID_ARG;
+
+            pthread_mutex_lock(&lock);
+
+            Mount *p = iterator->Partition;
+            Entry *entry = &p->Entries[iterator->Index];
+
+            memset(info, 0, sizeof(nvs_entry_info_t));
+            strncpy(info->namespace_name, p->Namespaces[iterator->Namespace], NVS_KEY_NAME_MAX_SIZE - 1);
+            strncpy(info->key, entry->Key, NVS_KEY_NAME_MAX_SIZE - 1);
+            info->type = (nvs_type_t)entry->Type;
+
+            pthread_mutex_unlock(&lock);
+
+            return ESP_OK;
+        }
+
+        void ReleaseIterator(iterator_t iterator)
+        {
+            delete iterator;
+        }
+    }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include "sdkconfig.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+
+#include "esp_err.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "backend.hpp"
+
+namespace database
+{
+    namespace backend
+    {
+        esp_err_t Init(const char *partition)
+        {
+            return nvs_flash_init_partition(partition);
+        }
+
+        esp_err_t Deinit(const char *partition)
+        {
+            return nvs_flash_deinit_partition(partition);
+        }
+
+        esp_err_t Erase(const char *partition)
+        {
+            return nvs_flash_erase_partition(partition);
+        }
+
+        esp_err_t Stats(const char *partition, nvs_stats_t *stats)
+        {
+            return nvs_get_stats(partition, stats);
+        }
+
+        esp_err_t Open(const char *partition, const char *nmspace, nvs_handle_t *handle)
+        {
+            return nvs_open_from_partition(partition, nmspace, NVS_READWRITE, handle);
+        }
+
+        void Close(nvs_handle_t handle)
+        {
+            nvs_close(handle);
+        }
+
+        esp_err_t Commit(nvs_handle_t handle)
+        {
+            return nvs_commit(handle);
+        }
+
+        esp_err_t GetU8(nvs_handle_t handle, const char *key, uint8_t *value)
+        {
+            return nvs_get_u8(handle, key, value);
+        }
+
+        esp_err_t SetU8(nvs_handle_t handle, const char *key, uint8_t value)
+        {
+            return nvs_set_u8(handle, key, value);
+        }
+
+        esp_err_t GetStr(nvs_handle_t handle, const char *key, char *value, size_t *length)
+        {
+            return nvs_get_str(handle, key, value, length);
+        }
+
+        esp_err_t SetStr(nvs_handle_t handle, const char *key, const char *value)
+        {
+            return nvs_set_str(handle, key, value);
+        }
+
+        esp_err_t GetBlob(nvs_handle_t handle, const char *key, void *value, size_t *length)
+        {
+            return nvs_get_blob(handle, key, value, length);
+        }
+
+        esp_err_t SetBlob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+        {
+            return nvs_set_blob(handle, key, value, length);
+        }
+
+        esp_err_t FindKey(nvs_handle_t handle, const char *key, nvs_type_t *type)
+        {
+            return nvs_find_key(handle, key, type);
+        }
+
+        esp_err_t EraseKey(nvs_handle_t handle, const char *key)
+        {
+            return nvs_erase_key(handle, key);
+        }
+
+        esp_err_t EraseAll(nvs_handle_t handle)
+        {
+            return nvs_erase_all(handle);
+        }
+
+        esp_err_t UsedEntries(nvs_handle_t handle, size_t *entries)
+        {
+            return nvs_get_used_entry_count(handle, entries);
+        }
+
+        esp_err_t EntryFind(const char *partition, const char *nmspace, nvs_type_t type, iterator_t *iterator)
+        {
+            return nvs_entry_find(partition, nmspace, type, (nvs_iterator_t *)iterator);
+        }
+
+        esp_err_t EntryNext(iterator_t *iterator)
+        {
+            return nvs_entry_next((nvs_iterator_t *)iterator);
+        }
+
+        esp_err_t EntryInfo(iterator_t iterator, nvs_entry_info_t *info)
+        {
+            return nvs_entry_info((nvs_iterator_t)iterator, info);
+        }
+
+        void ReleaseIterator(iterator_t iterator)
+        {
+            nvs_release_iterator((nvs_iterator_t)iterator);
+        }
+    }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,317 @@
+#include <string.h>
+#include "esp_err.h"
+#include "nvs.h"
+#include "cJSON.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "backend.hpp"
+#include "database.hpp"
+
+namespace database
+{
+    WriteBatch::WriteBatch()
+    {
+        this->operations = NULL;
+        this->last = NULL;
+        this->journaled = false;
+    }
+
+    WriteBatch::~WriteBatch()
+    {
+        this->clear();
+    }
+
+    void WriteBatch::clear()
+    {
+        while (this->operations != NULL)
+        {
+            Operation *operation = this->operations;
+            this->operations = operation->Next;
+
+            cJSON_Delete(operation->Value);
+            free((void *)operation->Data);
+            delete operation;
+        }
+        this->last = NULL;
+        this->journaled = false;
+    }
+
+    bool WriteBatch::superseded(Operation *operation)
+    {
+        // Only the last operation on a key tells what is stored
+        for (Operation *later = operation->Next; later != NULL; later = later->Next)
+            if (later->Target == operation->Target && !strcmp(later->Key, operation->Key))
+                return true;
+
+        return false;
+    }
+
+    void WriteBatch::stage(Handle *handle, const char *key, cJSON *value)
+    {
+        Operation *operation = new Operation();
+
+        operation->Target = handle;
+        strncpy(operation->Key, key, NVS_KEY_NAME_MAX_SIZE - 1);
+        operation->Key[NVS_KEY_NAME_MAX_SIZE - 1] = '\0';
+        operation->Value = value;
+        operation->Type = NVS_TYPE_ANY;
+        operation->Data = NULL;
+        operation->Size = 0;
+        operation->Next = NULL;
+
+        if (this->last != NULL)
+            this->last->Next = operation;
+        else
+            this->operations = operation;
+        this->last = operation;
+    }
+
+    void WriteBatch::Set(Handle *handle, const char *key, cJSON *value)
+    {
+        // The caller keeps the ownership of the value, as with Handle::Set
+        this->stage(handle, key, cJSON_Duplicate(value, true));
+    }
+
+    void WriteBatch::SetBlob(Handle *handle, const char *key, const void *value, size_t size)
+    {
+        this->stage(handle, key, NULL);
+
+        this->last->Type = NVS_TYPE_BLOB;
+        this->last->Data = (uint8_t *)malloc(size);
+        memcpy(this->last->Data, value, size);
+        this->last->Size = size;
+    }
+
+    void WriteBatch::Delete(Handle *handle, const char *key)
+    {
+        this->stage(handle, key, NULL);
+    }
+
+    esp_err_t WriteBatch::apply()
+    {
+        esp_err_t err;
+
+        Handle *system = Database::Instance->db;
+
+        // Serialize the records upfront to size the journal, superseded operations are neither journaled nor applied
+        size_t size = 1;
+        uint32_t count = 0;
+        for (Operation *operation = this->operations; operation != NULL; operation = operation->Next)
+        {
+            if (this->superseded(operation))
+                continue;
+
+            count++;
+
+            if (operation->Value != NULL)
+            {
+                err = operation->Target->serialize(operation->Value, &operation->Type, &operation->Data, &operation->Size);
+                if (err != ESP_OK)
+                    return err;
+
+                if (operation->Size > UINT16_MAX)
+                    return ESP_ERR_INVALID_SIZE;
+            }
+
+            size += strlen(operation->Target->nmspace) + 1 + strlen(operation->Key) + 1 + 3 + operation->Size;
+        }
+
+        // Index the new terms before anything is written, as Handle::Set does
+        for (Operation *operation = this->operations; operation != NULL; operation = operation->Next)
+        {
+            if (operation->Value == NULL || this->superseded(operation))
+                continue;
+
+            xSemaphoreTake(operation->Target->lock, portMAX_DELAY);
+            err = ESP_OK;
+            for (Index *index = operation->Target->indexes; err == ESP_OK && index != NULL; index = index->next)
+                err = index->add(operation->Key, operation->Value);
+            xSemaphoreGive(operation->Target->lock);
+            if (err != ESP_OK)
+                return err;
+        }
+
+        // Journal the batch, once it is committed the batch is applied no matter what.
+        // A single key is written atomically by NVS, so it needs no journal and is not written twice.
+        if (count > 1)
+        {
+            err = this->writeJournal(size);
+            if (err != ESP_OK)
+                return err;
+        }
+
+        // Apply the operations without committing
+        for (Operation *operation = this->operations; operation != NULL; operation = operation->Next)
+        {
+            if (this->superseded(operation))
+                continue;
+
+            Handle *target = operation->Target;
+
+            xSemaphoreTake(target->lock, portMAX_DELAY);
+            if (operation->Type != NVS_TYPE_ANY)
+            {
+                nvs_type_t type;
+                bool exists = backend::FindKey(target->handle, operation->Key, &type) == ESP_OK;
+
+                err = Handle::store(target->handle, operation->Key, operation->Type, operation->Data, operation->Size);
+                if (err == ESP_OK && !exists)
+                    target->count++;
+            }
+            else
+            {
+                err = backend::EraseKey(target->handle, operation->Key);
+                if (err == ESP_OK && target->count > 0)
+                    target->count--;
+                else if (err == ESP_ERR_NVS_NOT_FOUND)
+                    err = ESP_OK;
+            }
+            target->generation++;
+            xSemaphoreGive(target->lock);
+            if (err != ESP_OK)
+                return err;
+        }
+
+        // Commit once per handle
+        for (Operation *operation = this->operations; operation != NULL; operation = operation->Next)
+        {
+            Operation *previous = this->operations;
+            while (previous != operation && previous->Target != operation->Target)
+                previous = previous->Next;
+            if (previous != operation)
+                continue;
+
+            xSemaphoreTake(operation->Target->lock, portMAX_DELAY);
+            err = backend::Commit(operation->Target->handle);
+            xSemaphoreGive(operation->Target->lock);
+            if (err != ESP_OK)
+                return err;
+        }
+
+        // Forget the terms the records no longer have and refresh the caches
+        for (Operation *operation = this->operations; operation != NULL; operation = operation->Next)
+        {
+            if (this->superseded(operation))
+                continue;
+
+            // Blobs are not indexed nor cached
+            if (operation->Value == NULL && operation->Type != NVS_TYPE_ANY)
+                continue;
+
+            xSemaphoreTake(operation->Target->lock, portMAX_DELAY);
+            err = ESP_OK;
+            for (Index *index = operation->Target->indexes; err == ESP_OK && index != NULL; index = index->next)
+                err = index->prune(operation->Key, operation->Value);
+
+            // Cached while locked, as plain writes do, so they are never overtaken by an older record
+            if (err == ESP_OK && operation->Target->cache != NULL)
+            {
+                if (operation->Value != NULL)
+                    operation->Target->cache->Put(operation->Key, operation->Value, operation->Size);
+                else
+                    operation->Target->cache->Evict(operation->Key);
+            }
+            xSemaphoreGive(operation->Target->lock);
+            if (err != ESP_OK)
+                return err;
+        }
+
+        if (!this->journaled)
+            return ESP_OK;
+
+        xSemaphoreTake(system->lock, portMAX_DELAY);
+        err = backend::EraseKey(system->handle, JOURNAL_KEY);
+        if (err == ESP_OK)
+            err = backend::Commit(system->handle);
+        xSemaphoreGive(system->lock);
+        if (err == ESP_OK)
+            this->journaled = false;
+
+        return err;
+    }
+
+    esp_err_t WriteBatch::writeJournal(size_t size)
+    {
+        esp_err_t err;
+
+        Handle *system = Database::Instance->db;
+
+        // Operations are a sequence of namespace, key, record type, record size and record, deletes carry no record
+        uint8_t *journal = (uint8_t *)malloc(size);
+        if (journal == NULL)
+            return ESP_ERR_NO_MEM;
+
+        uint8_t *cursor = journal;
+        *cursor++ = JOURNAL_FORMAT;
+        for (Operation *operation = this->operations; operation != NULL; operation = operation->Next)
+        {
+            if (this->superseded(operation))
+                continue;
+
+            cursor = (uint8_t *)stpcpy((char *)cursor, operation->Target->nmspace) + 1;
+            cursor = (uint8_t *)stpcpy((char *)cursor, operation->Key) + 1;
+            *cursor++ = (uint8_t)operation->Type;
+            *cursor++ = operation->Size & 0xFF;
+            *cursor++ = (operation->Size >> 8) & 0xFF;
+            if (operation->Size > 0)
+                memcpy(cursor, operation->Data, operation->Size);
+            cursor += operation->Size;
+        }
+
+        xSemaphoreTake(system->lock, portMAX_DELAY);
+        err = backend::SetBlob(system->handle, JOURNAL_KEY, journal, cursor - journal);
+        if (err == ESP_OK)
+            err = backend::Commit(system->handle);
+        xSemaphoreGive(system->lock);
+        free((void *)journal);
+        if (err != ESP_OK)
+            return err;
+
+        this->journaled = true;
+
+        return ESP_OK;
+    }
+
+    esp_err_t WriteBatch::Commit()
+    {
+        esp_err_t err;
+
+        if (this->operations == NULL)
+            return ESP_OK;
+
+        // There is a single journal
+        xSemaphoreTake(Database::Instance->journal, portMAX_DELAY);
+        err = this->apply();
+
+        // A journaled batch is rolled forward right away, instead of being left half applied until the next boot,
+        // and is only reported as committed when the replay completes it
+        if (err != ESP_OK && this->journaled)
+        {
+            Handle *system = Database::Instance->db;
+
+            xSemaphoreTake(system->lock, portMAX_DELAY);
+            err = Database::Instance->replay();
+            xSemaphoreGive(system->lock);
+        }
+        xSemaphoreGive(Database::Instance->journal);
+
+        // Counts, caches and generations cannot be trusted after a replay or a failed batch
+        if (this->journaled || err != ESP_OK)
+        {
+            for (Operation *operation = this->operations; operation != NULL; operation = operation->Next)
+            {
+                xSemaphoreTake(operation->Target->lock, portMAX_DELAY);
+                operation->Target->counted = false;
+                operation->Target->generation++;
+                if (operation->Target->cache != NULL)
+                    operation->Target->cache->Evict(operation->Key);
+                xSemaphoreGive(operation->Target->lock);
+            }
+        }
+
+        // Batches can be reused
+        this->clear();
+
+        return err;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,182 @@
+#include <string.h>
+#include "esp_err.h"
+#include "cJSON.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "database.hpp"
+
+namespace database
+{
+    Cache *Cache::New(uint32_t budget)
+    {
+        Cache *cache = new Cache();
+
+        cache->lock = xSemaphoreCreateMutex();
+        if (!cache->lock)
+            ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+
+        cache->head = NULL;
+        cache->tail = NULL;
+        cache->budget = budget;
+        cache->size = 0;
+        cache->entries = 0;
+        cache->hits = 0;
+        cache->misses = 0;
+
+        return cache;
+    }
+
+    Cache::Entry *Cache::find(const char *key)
+    {
+        for (Entry *entry = this->head; entry != NULL; entry = entry->Next)
+            if (!strcmp(entry->Key, key))
+                return entry;
+
+        return NULL;
+    }
+
+    void Cache::link(Entry *entry)
+    {
+        entry->Prev = NULL;
+        entry->Next = this->head;
+
+        if (this->head != NULL)
+            this->head->Prev = entry;
+        else
+            this->tail = entry;
+
+        this->head = entry;
+    }
+
+    void Cache::unlink(Entry *entry)
+    {
+        if (entry->Prev != NULL)
+            entry->Prev->Next = entry->Next;
+        else
+            this->head = entry->Next;
+
+        if (entry->Next != NULL)
+            entry->Next->Prev = entry->Prev;
+        else
+            this->tail = entry->Prev;
+    }
+
+    void Cache::remove(Entry *entry)
+    {
+        this->unlink(entry);
+
+        this->size -= entry->Size;
+        this->entries--;
+
+        cJSON_Delete(entry->Value);
+        delete entry;
+    }
+
+    bool Cache::Get(const char *key, cJSON **value)
+    {
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+
+        Entry *entry = this->find(key);
+        if (entry == NULL)
+        {
+            this->misses++;
+            xSemaphoreGive(this->lock);
+            return false;
+        }
+
+        // Promote entry to most recently used
+        this->unlink(entry);
+        this->link(entry);
+
+        // Callers own the returned value, so hand out a copy
+        *value = cJSON_Duplicate(entry->Value, true);
+        this->hits++;
+
+        xSemaphoreGive(this->lock);
+
+        return true;
+    }
+
+    bool Cache::Peek(const char *key, cJSON **value)
+    {
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+
+        Entry *entry = this->find(key);
+        if (entry != NULL)
+            *value = cJSON_Duplicate(entry->Value, true);
+
+        xSemaphoreGive(this->lock);
+
+        return entry != NULL;
+    }
+
+    void Cache::Put(const char *key, cJSON *value, uint32_t size)
+    {
+        // Size is approximated by the serialized record length
+        size += sizeof(Entry);
+
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+
+        // Replace any stale entry
+        Entry *entry = this->find(key);
+        if (entry != NULL)
+            this->remove(entry);
+
+        // Records bigger than the whole budget are never cached
+        if (size > this->budget)
+        {
+            xSemaphoreGive(this->lock);
+            return;
+        }
+
+        // Evict least recently used entries until the record fits
+        while (this->size + size > this->budget)
+            this->remove(this->tail);
+
+        entry = new Entry();
+        strncpy(entry->Key, key, NVS_KEY_NAME_MAX_SIZE - 1);
+        entry->Key[NVS_KEY_NAME_MAX_SIZE - 1] = '\0';
+        entry->Value = cJSON_Duplicate(value, true);
+        entry->Size = size;
+
+        this->link(entry);
+        this->size += size;
+        this->entries++;
+
+        xSemaphoreGive(this->lock);
+    }
+
+    void Cache::Evict(const char *key)
+    {
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+
+        Entry *entry = this->find(key);
+        if (entry != NULL)
+            this->remove(entry);
+
+        xSemaphoreGive(this->lock);
+    }
+
+    void Cache::Clear()
+    {
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+
+        while (this->head != NULL)
+            this->remove(this->head);
+
+        xSemaphoreGive(this->lock);
+    }
+
+    void Cache::Stats(CacheStats *stats)
+    {
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+
+        stats->Hits = this->hits;
+        stats->Misses = this->misses;
+        stats->Entries = this->entries;
+        stats->Size = this->size;
+        stats->Budget = this->budget;
+
+        xSemaphoreGive(this->lock);
+    }
+}
\ No newline at end of file
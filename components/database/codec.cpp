@@ -0,0 +1,365 @@
+#include <string.h>
+#include "esp_err.h"
+#include "cJSON.h"
+#include "database.hpp"
+
+namespace database
+{
+    static size_t varintSize(uint64_t value)
+    {
+        size_t size = 1;
+
+        while (value >= 0x80)
+        {
+            value >>= 7;
+            size++;
+        }
+
+        return size;
+    }
+
+    static uint8_t *writeVarint(uint8_t *dst, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            *dst++ = (value & 0x7F) | 0x80;
+            value >>= 7;
+        }
+        *dst++ = value;
+
+        return dst;
+    }
+
+    static const uint8_t *readVarint(const uint8_t *src, const uint8_t *end, uint64_t *value)
+    {
+        *value = 0;
+
+        for (int shift = 0; src < end && shift < 64; shift += 7)
+        {
+            uint8_t byte = *src++;
+            *value |= (uint64_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                return src;
+        }
+
+        return NULL;
+    }
+
+    static uint64_t zigzag(int64_t value)
+    {
+        return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+    }
+
+    static int64_t unzigzag(uint64_t value)
+    {
+        return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+    }
+
+    static bool isPresent(cJSON *item, FieldType type)
+    {
+        switch (type)
+        {
+        case FIELD_STRING:
+            return cJSON_IsString(item);
+        case FIELD_NUMBER:
+            return cJSON_IsNumber(item);
+        case FIELD_STRINGS:
+            return cJSON_IsArray(item);
+        case FIELD_OBJECT:
+            return cJSON_IsObject(item);
+        default:
+            return false;
+        }
+    }
+
+    static size_t measure(cJSON *src, const Schema *schema)
+    {
+        uint32_t presence = 0;
+        size_t size = 0;
+
+        for (int i = 0; i < schema->Size; i++)
+        {
+            const Field *field = &schema->Fields[i];
+            cJSON *item = cJSON_GetObjectItem(src, field->Name);
+            if (!isPresent(item, field->Type))
+                continue;
+
+            presence |= 1U << i;
+
+            switch (field->Type)
+            {
+            case FIELD_STRING:
+            {
+                size_t length = strlen(item->valuestring);
+                size += varintSize(length) + length;
+                break;
+            }
+
+            case FIELD_NUMBER:
+                size += varintSize(zigzag((int64_t)item->valuedouble));
+                break;
+
+            case FIELD_STRINGS:
+            {
+                size += varintSize(cJSON_GetArraySize(item));
+
+                cJSON *element;
+                cJSON_ArrayForEach(element, item)
+                {
+                    size_t length = cJSON_IsString(element) ? strlen(element->valuestring) : 0;
+                    size += varintSize(length) + length;
+                }
+                break;
+            }
+
+            case FIELD_OBJECT:
+                size += measure(item, field->Nested);
+                break;
+            }
+        }
+
+        return varintSize(presence) + size;
+    }
+
+    static uint8_t *write(uint8_t *dst, cJSON *src, const Schema *schema)
+    {
+        uint32_t presence = 0;
+
+        for (int i = 0; i < schema->Size; i++)
+            if (isPresent(cJSON_GetObjectItem(src, schema->Fields[i].Name), schema->Fields[i].Type))
+                presence |= 1U << i;
+
+        // Absent fields cost nothing but a bit in the presence mask
+        dst = writeVarint(dst, presence);
+
+        for (int i = 0; i < schema->Size; i++)
+        {
+            if (!(presence & (1U << i)))
+                continue;
+
+            const Field *field = &schema->Fields[i];
+            cJSON *item = cJSON_GetObjectItem(src, field->Name);
+
+            switch (field->Type)
+            {
+            case FIELD_STRING:
+            {
+                size_t length = strlen(item->valuestring);
+                dst = writeVarint(dst, length);
+                memcpy(dst, item->valuestring, length);
+                dst += length;
+                break;
+            }
+
+            case FIELD_NUMBER:
+                dst = writeVarint(dst, zigzag((int64_t)item->valuedouble));
+                break;
+
+            case FIELD_STRINGS:
+            {
+                dst = writeVarint(dst, cJSON_GetArraySize(item));
+
+                cJSON *element;
+                cJSON_ArrayForEach(element, item)
+                {
+                    size_t length = cJSON_IsString(element) ? strlen(element->valuestring) : 0;
+                    dst = writeVarint(dst, length);
+                    memcpy(dst, element->valuestring, length);
+                    dst += length;
+                }
+                break;
+            }
+
+            case FIELD_OBJECT:
+                dst = write(dst, item, field->Nested);
+                break;
+            }
+        }
+
+        return dst;
+    }
+
+    static char *readString(const uint8_t **src, const uint8_t *end, esp_err_t *err)
+    {
+        uint64_t length;
+
+        *src = readVarint(*src, end, &length);
+        if (*src == NULL || length > (uint64_t)(end - *src))
+            return NULL;
+
+        // Allocated through cJSON so the string can be handed over to a node
+        char *string = (char *)cJSON_malloc(length + 1);
+        if (string == NULL)
+        {
+            *err = ESP_ERR_NO_MEM;
+            return NULL;
+        }
+
+        memcpy(string, *src, length);
+        string[length] = '\0';
+        *src += length;
+
+        return string;
+    }
+
+    static cJSON *createString(char *string)
+    {
+        // Take ownership of the string instead of copying it
+        cJSON *item = cJSON_CreateNull();
+        if (item == NULL)
+        {
+            cJSON_free(string);
+            return NULL;
+        }
+
+        item->type = cJSON_String;
+        item->valuestring = string;
+
+        return item;
+    }
+
+    // Returns NULL on malformed records, and on allocation failures, which set err to ESP_ERR_NO_MEM
+    static const uint8_t *read(const uint8_t *src, const uint8_t *end, cJSON *dst, const Schema *schema, esp_err_t *err)
+    {
+        uint64_t presence;
+
+        src = readVarint(src, end, &presence);
+        if (src == NULL)
+            return NULL;
+
+        // Fields are only ever appended, so unknown ones mean the record is from a newer schema
+        if (presence >> schema->Size)
+            return NULL;
+
+        for (int i = 0; i < schema->Size; i++)
+        {
+            if (!(presence & (1U << i)))
+                continue;
+
+            const Field *field = &schema->Fields[i];
+
+            switch (field->Type)
+            {
+            case FIELD_STRING:
+            {
+                char *string = readString(&src, end, err);
+                if (string == NULL)
+                    return NULL;
+
+                cJSON *item = createString(string);
+                if (item == NULL || !cJSON_AddItemToObject(dst, field->Name, item))
+                {
+                    cJSON_Delete(item);
+                    *err = ESP_ERR_NO_MEM;
+                    return NULL;
+                }
+                break;
+            }
+
+            case FIELD_NUMBER:
+            {
+                uint64_t number;
+                src = readVarint(src, end, &number);
+                if (src == NULL)
+                    return NULL;
+
+                if (cJSON_AddNumberToObject(dst, field->Name, unzigzag(number)) == NULL)
+                {
+                    *err = ESP_ERR_NO_MEM;
+                    return NULL;
+                }
+                break;
+            }
+
+            case FIELD_STRINGS:
+            {
+                uint64_t count;
+                src = readVarint(src, end, &count);
+                if (src == NULL)
+                    return NULL;
+
+                cJSON *array = cJSON_AddArrayToObject(dst, field->Name);
+                if (array == NULL)
+                {
+                    *err = ESP_ERR_NO_MEM;
+                    return NULL;
+                }
+
+                for (uint64_t j = 0; j < count; j++)
+                {
+                    char *string = readString(&src, end, err);
+                    if (string == NULL)
+                        return NULL;
+
+                    cJSON *item = createString(string);
+                    if (item == NULL)
+                    {
+                        *err = ESP_ERR_NO_MEM;
+                        return NULL;
+                    }
+
+                    cJSON_AddItemToArray(array, item);
+                }
+                break;
+            }
+
+            case FIELD_OBJECT:
+            {
+                cJSON *object = cJSON_AddObjectToObject(dst, field->Name);
+                if (object == NULL)
+                {
+                    *err = ESP_ERR_NO_MEM;
+                    return NULL;
+                }
+
+                src = read(src, end, object, field->Nested, err);
+                if (src == NULL)
+                    return NULL;
+                break;
+            }
+            }
+        }
+
+        return src;
+    }
+
+    esp_err_t Schema::Encode(cJSON *src, uint8_t **dst, size_t *size) const
+    {
+        // Header: record format and schema version
+        *size = 2 + measure(src, this);
+
+        uint8_t *record = (uint8_t *)malloc(*size);
+        if (record == NULL)
+            return ESP_ERR_NO_MEM;
+
+        record[0] = RECORD_FORMAT;
+        record[1] = this->Version;
+        write(&record[2], src, this);
+
+        *dst = record;
+
+        return ESP_OK;
+    }
+
+    esp_err_t Schema::Decode(const uint8_t *src, size_t size, cJSON **dst) const
+    {
+        if (size < 2 || src[0] != RECORD_FORMAT)
+            return ESP_ERR_INVALID_VERSION;
+
+        cJSON *record = cJSON_CreateObject();
+        if (record == NULL)
+            return ESP_ERR_NO_MEM;
+
+        // Records that cannot be read are malformed unless an allocation failed
+        esp_err_t err = ESP_ERR_INVALID_SIZE;
+        if (read(&src[2], src + size, record, this, &err) == NULL)
+        {
+            cJSON_Delete(record);
+            return err;
+        }
+
+        *dst = record;
+
+        return ESP_OK;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#include <string.h>
+#include "esp_err.h"
+#include "database.hpp"
+
+namespace database
+{
+    static const char *CURSOR_CHARSET = "0123456789abcdef";
+
+    Cursor::Cursor()
+    {
+        memset(this->Key, 0, sizeof(this->Key));
+        this->More = false;
+    }
+
+    esp_err_t Cursor::Decode(const char *token)
+    {
+        size_t length = strlen(token);
+        if (length % 2 != 0 || length >= CURSOR_TOKEN_SIZE)
+            return ESP_ERR_INVALID_ARG;
+
+        for (size_t i = 0; i < length; i += 2)
+        {
+            const char *high = strchr(CURSOR_CHARSET, token[i]);
+            const char *low = strchr(CURSOR_CHARSET, token[i + 1]);
+            if (high == NULL || low == NULL || token[i] == '\0' || token[i + 1] == '\0')
+                return ESP_ERR_INVALID_ARG;
+
+            this->Key[i / 2] = ((high - CURSOR_CHARSET) << 4) | (low - CURSOR_CHARSET);
+        }
+        this->Key[length / 2] = '\0';
+
+        return ESP_OK;
+    }
+
+    void Cursor::Encode(char token[CURSOR_TOKEN_SIZE]) const
+    {
+        size_t i = 0;
+        for (; this->Key[i] != '\0'; i++)
+        {
+            token[i * 2] = CURSOR_CHARSET[((uint8_t)this->Key[i] >> 4) & 0x0F];
+            token[i * 2 + 1] = CURSOR_CHARSET[(uint8_t)this->Key[i] & 0x0F];
+        }
+        token[i * 2] = '\0';
+    }
+}
\ No newline at end of file
@@ -1,7 +1,12 @@
+#include <string.h>
 #include "esp_err.h"
-#include "nvs_flash.h"
+#include "nvs.h"
 #include "cJSON.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
 #include "logger.hpp"
+#include "backend.hpp"
 #include "database.hpp"
 
 namespace database
@@ -16,8 +21,16 @@ namespace database
         // Inject dependencies
         Instance->logger = logger;
 
+        Instance->handles = NULL;
+
+        Allocations::Track();
+
+        Instance->journal = xSemaphoreCreateMutex();
+        if (!Instance->journal)
+            ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+
         // Initialize database NVS partition
-        esp_err_t err = nvs_flash_init_partition(PARTITION);
+        esp_err_t err = backend::Init(PARTITION);
         // Database NVS partition has been truncated or format cannot be recognized
         if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND)
             Instance->reset();
@@ -32,30 +45,57 @@ namespace database
 
         Instance->db = Instance->Open(DB_NAMESPACE);
 
-        // Check if a reset has been scheduled
-        cJSON *reset = NULL;
-        ESP_ERROR_CHECK(Instance->db->Get("reset", &reset));
-        if (reset != NULL)
-        {
-            cJSON_Delete(reset);
+        // Check if a reset has been scheduled, note that its record format depends on the namespace schema
+        bool reset;
+        ESP_ERROR_CHECK(Instance->db->Exists("reset", &reset));
+        if (reset)
             Instance->reset();
-        }
+
+        // Complete the write batch interrupted by the last power loss, if any
+        err = Instance->replay();
+        if (err != ESP_OK)
+            Instance->logger->Error(TAG, "Could not complete interrupted write batch: %d", err);
 
         return Instance;
     }
 
     void Database::Info(nvs_stats_t *info)
     {
-        ESP_ERROR_CHECK(nvs_get_stats(PARTITION, info));
+        ESP_ERROR_CHECK(backend::Stats(PARTITION, info));
     }
 
     Handle *Database::Open(const char *nmspace)
     {
+        // Share handles between openers of the same namespace so their caches stay coherent
+        for (Handle *handle = this->handles; handle != NULL; handle = handle->next)
+            if (!strcmp(handle->nmspace, nmspace))
+                return handle;
+
         Handle *handle = new Handle();
 
         handle->nmspace = nmspace;
+        handle->schema = NULL;
+        handle->cache = NULL;
+        handle->iterators = 0;
+        handle->migrations = NULL;
+        handle->indexes = NULL;
+        handle->count = 0;
+        handle->counted = false;
+        handle->generation = 0;
+        memset(handle->operations, 0, sizeof(handle->operations));
 
-        ESP_ERROR_CHECK(nvs_open_from_partition(PARTITION, handle->nmspace, NVS_READWRITE, &handle->handle));
+        handle->lock = xSemaphoreCreateMutex();
+        if (!handle->lock)
+            ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+
+        ESP_ERROR_CHECK(backend::Open(PARTITION, handle->nmspace, &handle->handle));
+
+        // Seed the record count, from now on it is kept up to date by the writes
+        uint32_t count;
+        ESP_ERROR_CHECK(handle->Count(&count));
+
+        handle->next = this->handles;
+        this->handles = handle;
 
         return handle;
     }
@@ -63,12 +103,96 @@ namespace database
     void Database::reset()
     {
         this->logger->Debug(TAG, "Resetting database");
-        ESP_ERROR_CHECK(nvs_flash_deinit_partition(PARTITION));
-        ESP_ERROR_CHECK(nvs_flash_erase_partition(PARTITION));
-        ESP_ERROR_CHECK(nvs_flash_init_partition(PARTITION));
+        ESP_ERROR_CHECK(backend::Deinit(PARTITION));
+        ESP_ERROR_CHECK(backend::Erase(PARTITION));
+        ESP_ERROR_CHECK(backend::Init(PARTITION));
         this->logger->Debug(TAG, "Database reseted");
     }
 
+    esp_err_t Database::replay()
+    {
+        esp_err_t err;
+
+        size_t size;
+        err = backend::GetBlob(this->db->handle, JOURNAL_KEY, NULL, &size);
+        if (err == ESP_ERR_NVS_NOT_FOUND)
+            return ESP_OK;
+        else if (err != ESP_OK)
+            return err;
+
+        uint8_t *journal = (uint8_t *)malloc(size);
+        if (journal == NULL)
+            return ESP_ERR_NO_MEM;
+
+        err = backend::GetBlob(this->db->handle, JOURNAL_KEY, journal, &size);
+        if (err != ESP_OK)
+        {
+            free((void *)journal);
+            return err;
+        }
+
+        this->logger->Warn(TAG, "Replaying interrupted write batch");
+
+        // Operations are a sequence of namespace, key, record type, record size and record
+        const uint8_t *cursor = journal + 1;
+        const uint8_t *end = journal + size;
+        while (journal[0] == JOURNAL_FORMAT && cursor < end)
+        {
+            const char *nmspace = (const char *)cursor;
+            cursor += strnlen(nmspace, end - cursor) + 1;
+            const char *key = (const char *)cursor;
+            cursor += strnlen(key, end - cursor) + 1;
+            if (cursor + 3 > end)
+                break;
+
+            nvs_type_t type = (nvs_type_t)cursor[0];
+            size_t dataSize = cursor[1] | (cursor[2] << 8);
+            const uint8_t *data = cursor + 3;
+            cursor += 3 + dataSize;
+            if (cursor > end)
+                break;
+
+            nvs_handle_t handle;
+            err = backend::Open(PARTITION, nmspace, &handle);
+            if (err != ESP_OK)
+                break;
+
+            // Operations are idempotent, so replaying the ones that were already applied is harmless
+            if (type == NVS_TYPE_ANY)
+            {
+                err = backend::EraseKey(handle, key);
+                if (err == ESP_ERR_NVS_NOT_FOUND)
+                    err = ESP_OK;
+            }
+            else
+                err = Handle::store(handle, key, type, data, dataSize);
+
+            if (err == ESP_OK)
+                err = backend::Commit(handle);
+            backend::Close(handle);
+            if (err != ESP_OK)
+                break;
+        }
+
+        free((void *)journal);
+
+        // A batch that cannot be completed, such as one that does not fit anymore, would fail on every boot,
+        // so its journal is dropped and the batch is left as far as it was applied
+        if (err != ESP_OK)
+            this->logger->Error(TAG, "Could not replay write batch: %d, dropping its journal", err);
+
+        esp_err_t dropErr = backend::EraseKey(this->db->handle, JOURNAL_KEY);
+        if (dropErr == ESP_OK)
+            dropErr = backend::Commit(this->db->handle);
+        if (err == ESP_OK)
+            err = dropErr;
+
+        // Handles are opened after the replay, except the system one
+        this->db->counted = false;
+
+        return err;
+    }
+
     void Database::ScheduleReset()
     {
         cJSON *json = cJSON_CreateObject();
@@ -76,28 +200,251 @@ namespace database
         cJSON_Delete(json);
     }
 
-    esp_err_t Handle::Drop()
+    esp_err_t Handle::getText(const char *key, cJSON **value, uint32_t *size)
+    {
+        esp_err_t err;
+
+        // Size includes the zero-terminator
+        err = backend::GetStr(this->handle, key, NULL, (size_t *)size);
+        if (err == ESP_ERR_NVS_NOT_FOUND)
+            return ESP_OK;
+        else if (err != ESP_OK)
+            return err;
+
+        char *item = (char *)malloc(*size);
+
+        err = backend::GetStr(this->handle, key, item, (size_t *)size);
+        if (err != ESP_OK)
+        {
+            free((void *)item);
+
+            if (err == ESP_ERR_NVS_NOT_FOUND)
+                return ESP_OK;
+            return err;
+        }
+
+        *value = cJSON_Parse(item);
+        free((void *)item);
+
+        return ESP_OK;
+    }
+
+    esp_err_t Handle::getRecord(const char *key, cJSON **value, uint32_t *size)
+    {
+        esp_err_t err;
+
+        uint8_t buffer[RECORD_BUFFER_SIZE];
+        uint8_t *record = buffer;
+        *size = sizeof(buffer);
+
+        // Most records fit in the stack buffer, saving the size query
+        err = backend::GetBlob(this->handle, key, record, (size_t *)size);
+        if (err == ESP_ERR_NVS_INVALID_LENGTH)
+        {
+            record = (uint8_t *)malloc(*size);
+            if (record == NULL)
+                return ESP_ERR_NO_MEM;
+
+            err = backend::GetBlob(this->handle, key, record, (size_t *)size);
+        }
+
+        if (err == ESP_OK)
+            err = this->schema->Decode(record, *size, value);
+
+        if (record != buffer)
+            free((void *)record);
+
+        return err;
+    }
+
+    esp_err_t Handle::serialize(cJSON *value, nvs_type_t *type, uint8_t **data, size_t *size)
+    {
+        // Namespaces without a schema store records as JSON text
+        if (this->schema == NULL)
+        {
+            *type = NVS_TYPE_STR;
+            *data = (uint8_t *)cJSON_PrintUnformatted(value);
+            *size = strlen((const char *)*data) + 1;
+            return ESP_OK;
+        }
+
+        *type = NVS_TYPE_BLOB;
+        return this->schema->Encode(value, data, size);
+    }
+
+    esp_err_t Handle::store(nvs_handle_t handle, const char *key, nvs_type_t type, const uint8_t *data, size_t size)
     {
         esp_err_t err;
 
-        err = nvs_erase_all(this->handle);
+        if (type == NVS_TYPE_STR)
+            err = backend::SetStr(handle, key, (const char *)data);
+        else
+            err = backend::SetBlob(handle, key, data, size);
+
+        // The key still holds a record of the other type, such as a legacy JSON text record
+        if (err == ESP_ERR_NVS_TYPE_MISMATCH)
+        {
+            err = backend::EraseKey(handle, key);
+            if (err == ESP_OK)
+                return store(handle, key, type, data, size);
+        }
+
+        return err;
+    }
+
+    esp_err_t Handle::write(const char *key, cJSON *value, uint32_t *size)
+    {
+        esp_err_t err;
+
+        nvs_type_t type;
+        uint8_t *data;
+        size_t dataSize;
+
+        err = this->serialize(value, &type, &data, &dataSize);
         if (err != ESP_OK)
             return err;
 
-        err = nvs_commit(this->handle);
+        *size = dataSize;
+
+        err = store(this->handle, key, type, data, dataSize);
+        free((void *)data);
+        if (err != ESP_OK)
+            return err;
+
+        return backend::Commit(this->handle);
+    }
+
+    esp_err_t Handle::migrate(const char *key, cJSON *value)
+    {
+        esp_err_t err;
+
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+
+        // Updating an NVS entry while iterating is not possible, defer it until the namespace is no longer iterated
+        if (this->iterators > 0)
+        {
+            Migration *migration = this->migrations;
+            while (migration != NULL && strcmp(migration->Key, key))
+                migration = migration->Next;
+
+            if (migration == NULL)
+            {
+                migration = new Migration();
+                strcpy(migration->Key, key);
+                migration->Next = this->migrations;
+                this->migrations = migration;
+            }
+
+            xSemaphoreGive(this->lock);
+            return ESP_OK;
+        }
+
+        // Ensure the key has not been rewritten since it was read
+        size_t length;
+        err = backend::GetStr(this->handle, key, NULL, &length);
+        if (err != ESP_OK)
+        {
+            xSemaphoreGive(this->lock);
+            return err == ESP_ERR_NVS_NOT_FOUND ? ESP_OK : err;
+        }
+
+        err = backend::EraseKey(this->handle, key);
+        if (err == ESP_OK)
+        {
+            uint32_t size;
+            err = this->write(key, value, &size);
+        }
+
+        xSemaphoreGive(this->lock);
+
+        return err;
+    }
+
+    void Handle::beginIteration()
+    {
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+        this->iterators++;
+        xSemaphoreGive(this->lock);
+    }
+
+    void Handle::endIteration()
+    {
+        Migration *migrations = NULL;
+
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+        this->iterators--;
+        if (this->iterators == 0)
+        {
+            migrations = this->migrations;
+            this->migrations = NULL;
+        }
+        xSemaphoreGive(this->lock);
+
+        // Run the migrations deferred while iterating
+        while (migrations != NULL)
+        {
+            Migration *migration = migrations;
+            migrations = migration->Next;
+
+            cJSON *value = NULL;
+            uint32_t size;
+            if (this->getText(migration->Key, &value, &size) == ESP_OK && value != NULL)
+                this->migrate(migration->Key, value);
+            cJSON_Delete(value);
+
+            delete migration;
+        }
+    }
+
+    esp_err_t Handle::Drop()
+    {
+        esp_err_t err;
+
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+
+        err = backend::EraseAll(this->handle);
+        if (err == ESP_OK)
+            err = backend::Commit(this->handle);
+
+        this->count = 0;
+        this->counted = err == ESP_OK;
+        this->generation++;
+
+        for (Index *index = this->indexes; err == ESP_OK && index != NULL; index = index->next)
+        {
+            err = index->clear();
+            if (err == ESP_OK)
+                err = index->seal();
+        }
+
+        // Cleared while still locked, so no read of the old records is cached afterwards
+        if (this->cache != NULL)
+            this->cache->Clear();
+
+        xSemaphoreGive(this->lock);
+
         if (err != ESP_OK)
             return err;
 
         return ESP_OK;
     }
 
-    esp_err_t Handle::Count(uint32_t *count)
+    esp_err_t Handle::countRecords(uint32_t *count)
     {
         esp_err_t err;
 
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+        bool counted = this->counted;
+        *count = this->count;
+        xSemaphoreGive(this->lock);
+
+        if (counted)
+            return ESP_OK;
+
+        // Rebuild the count when it is unknown, such as after a failed write
         *count = 0;
 
-        err = this->Find(
+        err = this->find(
             [](const char *key, void *context) -> bool
             {
                 (*(uint32_t *)context)++;
@@ -107,86 +454,143 @@ namespace database
         if (err != ESP_OK)
             return err;
 
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+        this->count = *count;
+        this->counted = true;
+        xSemaphoreGive(this->lock);
+
         return ESP_OK;
     }
 
-    esp_err_t Handle::Get(const char *key, cJSON **value)
+    esp_err_t Handle::read(const char *key, cJSON **value, uint32_t *size)
     {
         esp_err_t err;
 
-        uint32_t size;
+        // Namespaces with a schema store records in binary
+        err = ESP_ERR_NVS_NOT_FOUND;
+        if (this->schema != NULL)
+            err = this->getRecord(key, value, size);
 
-        // Size includes the zero-terminator
-        err = nvs_get_str(this->handle, key, NULL, (size_t *)&size);
-        if (err == ESP_ERR_NVS_NOT_FOUND)
-            return ESP_OK;
+        // Fallback to JSON text, which is also how records were stored before schemas
+        if (err == ESP_ERR_NVS_NOT_FOUND || err == ESP_ERR_NVS_TYPE_MISMATCH)
+        {
+            err = this->getText(key, value, size);
+            if (err != ESP_OK)
+                return err;
+
+            // Lazily migrate legacy records, failed migrations are retried on the next read
+            if (this->schema != NULL && *value != NULL)
+                this->migrate(key, *value);
+        }
         else if (err != ESP_OK)
             return err;
 
-        char *item = (char *)malloc(size);
+        return ESP_OK;
+    }
 
-        err = nvs_get_str(this->handle, key, item, (size_t *)&size);
-        if (err != ESP_OK)
-        {
-            free((void *)item);
+    esp_err_t Handle::get(const char *key, cJSON **value)
+    {
+        esp_err_t err;
 
-            if (err == ESP_ERR_NVS_NOT_FOUND)
-                return ESP_OK;
+        uint32_t size;
+
+        // Serve hot records without touching flash
+        if (this->cache != NULL && this->cache->Get(key, value))
+            return ESP_OK;
+
+        uint32_t generation = this->Generation();
+
+        err = this->read(key, value, &size);
+        if (err != ESP_OK)
             return err;
-        }
 
-        *value = cJSON_Parse(item);
-        free((void *)item);
+        // Writes cache their records while locked, so only cache the read if no write happened since it started,
+        // otherwise an older record could replace a newer one
+        if (this->cache != NULL && *value != NULL)
+        {
+            xSemaphoreTake(this->lock, portMAX_DELAY);
+            if (this->generation == generation)
+                this->cache->Put(key, *value, size);
+            xSemaphoreGive(this->lock);
+        }
 
         return ESP_OK;
     }
 
-    esp_err_t Handle::Set(const char *key, cJSON *value)
+    esp_err_t Handle::set(const char *key, cJSON *value)
     {
         esp_err_t err;
 
-        const char *item = cJSON_PrintUnformatted(value);
+        uint32_t size;
 
-        err = nvs_set_str(this->handle, key, item);
-        if (err != ESP_OK)
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+
+        // Index the new terms before writing, so indexes never miss a stored record
+        err = ESP_OK;
+        for (Index *index = this->indexes; err == ESP_OK && index != NULL; index = index->next)
+            err = index->add(key, value);
+
+        if (err == ESP_OK)
         {
-            free((void *)item);
-            return err;
+            nvs_type_t type;
+            bool exists = backend::FindKey(this->handle, key, &type) == ESP_OK;
+
+            err = this->write(key, value, &size);
+            if (err != ESP_OK)
+                this->counted = false;
+            else if (!exists)
+                this->count++;
+
+            this->generation++;
         }
 
-        err = nvs_commit(this->handle);
-        if (err != ESP_OK)
+        // And only then forget the terms the record no longer has
+        for (Index *index = this->indexes; err == ESP_OK && index != NULL; index = index->next)
+            err = index->prune(key, value);
+
+        // Write-through so the next read is served from memory, or forget it if the stored record is unknown now
+        if (this->cache != NULL)
         {
-            free((void *)item);
-            return err;
+            if (err == ESP_OK)
+                this->cache->Put(key, value, size);
+            else
+                this->cache->Evict(key);
         }
 
-        free((void *)item);
+        xSemaphoreGive(this->lock);
+
+        if (err != ESP_OK)
+            return err;
 
         return ESP_OK;
     }
 
-    esp_err_t Handle::Find(db_find_cb_t find, void *context)
+    esp_err_t Handle::find(db_find_cb_t find, void *context)
     {
         esp_err_t err;
 
         nvs_entry_info_t itemInfo;
-        nvs_iterator_t iter = NULL;
+        backend::iterator_t iter = NULL;
 
-        err = nvs_entry_find(PARTITION, this->nmspace, NVS_TYPE_STR, &iter);
+        // Records can be either binary or legacy JSON text
+        err = backend::EntryFind(PARTITION, this->nmspace, NVS_TYPE_ANY, &iter);
         if (err == ESP_ERR_NVS_NOT_FOUND)
             return ESP_OK;
         else if (err != ESP_OK)
             return err;
 
+        this->beginIteration();
+
         while (err == ESP_OK)
         {
-            nvs_entry_info(iter, &itemInfo);
+            backend::EntryInfo(iter, &itemInfo);
             if (find(itemInfo.key, context))
                 break;
-            err = nvs_entry_next(&iter);
+            err = backend::EntryNext(&iter);
         }
-        nvs_release_iterator(iter);
+        backend::ReleaseIterator(iter);
+
+        this->endIteration();
 
         if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)
             return err;
@@ -194,20 +598,604 @@ namespace database
         return ESP_OK;
     }
 
-    esp_err_t Handle::Delete(const char *key)
+    esp_err_t Handle::scan(db_scan_cb_t scan, void *context)
     {
         esp_err_t err;
 
-        err = nvs_erase_key(this->handle, key);
+        nvs_entry_info_t itemInfo;
+        backend::iterator_t iter = NULL;
+
+        err = backend::EntryFind(PARTITION, this->nmspace, NVS_TYPE_ANY, &iter);
         if (err == ESP_ERR_NVS_NOT_FOUND)
             return ESP_OK;
         else if (err != ESP_OK)
             return err;
 
-        err = nvs_commit(this->handle);
+        this->beginIteration();
+
+        while (err == ESP_OK)
+        {
+            backend::EntryInfo(iter, &itemInfo);
+
+            cJSON *value = NULL;
+            uint32_t size;
+
+            // Scanned records are not cached, as a full scan would evict every hot record
+            if (this->cache == NULL || !this->cache->Peek(itemInfo.key, &value))
+            {
+                if (itemInfo.type == NVS_TYPE_BLOB && this->schema != NULL)
+                    err = this->getRecord(itemInfo.key, &value, &size);
+                else if (itemInfo.type == NVS_TYPE_STR)
+                {
+                    err = this->getText(itemInfo.key, &value, &size);
+                    // Deferred until the scan ends
+                    if (err == ESP_OK && this->schema != NULL && value != NULL)
+                        this->migrate(itemInfo.key, value);
+                }
+            }
+            if (err != ESP_OK)
+                break;
+
+            bool stop = value != NULL && scan(itemInfo.key, value, context);
+            cJSON_Delete(value);
+            if (stop)
+                break;
+
+            err = backend::EntryNext(&iter);
+        }
+        backend::ReleaseIterator(iter);
+
+        this->endIteration();
+
+        if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)
+            return err;
+
+        return ESP_OK;
+    }
+
+    esp_err_t Handle::scan(db_scan_cb_t scan, void *context, uint32_t limit, Cursor *cursor)
+    {
+        esp_err_t err;
+
+        nvs_entry_info_t itemInfo;
+        backend::iterator_t iter = NULL;
+
+        // NVS iteration order changes whenever a record is rewritten, so pages follow key order instead
+        char *keys = (char *)malloc(limit * NVS_KEY_NAME_MAX_SIZE);
+        if (keys == NULL)
+            return ESP_ERR_NO_MEM;
+
+        uint32_t size = 0;
+        bool more = false;
+
+        err = backend::EntryFind(PARTITION, this->nmspace, NVS_TYPE_ANY, &iter);
+        if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)
+        {
+            free((void *)keys);
+            return err;
+        }
+
+        bool iterating = err == ESP_OK;
+        if (iterating)
+            this->beginIteration();
+
+        // Select the lowest keys after the cursor in a max-heap, only entry metadata is read
+        while (err == ESP_OK)
+        {
+            backend::EntryInfo(iter, &itemInfo);
+
+            if (strcmp(itemInfo.key, cursor->Key) > 0)
+            {
+                if (size < limit)
+                {
+                    // Sift the new key up
+                    uint32_t i = size++;
+                    strcpy(keys + i * NVS_KEY_NAME_MAX_SIZE, itemInfo.key);
+                    while (i > 0 && strcmp(keys + ((i - 1) / 2) * NVS_KEY_NAME_MAX_SIZE, keys + i * NVS_KEY_NAME_MAX_SIZE) < 0)
+                    {
+                        swapKeys(keys, i, (i - 1) / 2);
+                        i = (i - 1) / 2;
+                    }
+                }
+                else
+                {
+                    more = true;
+
+                    // Replace the highest key of the page
+                    if (strcmp(itemInfo.key, keys) < 0)
+                    {
+                        strcpy(keys, itemInfo.key);
+                        siftKeys(keys, size, 0);
+                    }
+                }
+            }
+
+            err = backend::EntryNext(&iter);
+        }
+
+        backend::ReleaseIterator(iter);
+        if (iterating)
+            this->endIteration();
+
+        if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)
+        {
+            free((void *)keys);
+            return err;
+        }
+
+        // Sort the page keys in place
+        for (uint32_t end = size; end > 1; end--)
+        {
+            swapKeys(keys, 0, end - 1);
+            siftKeys(keys, end - 1, 0);
+        }
+
+        // Read the page records
+        err = ESP_OK;
+        for (uint32_t i = 0; i < size; i++)
+        {
+            const char *key = keys + i * NVS_KEY_NAME_MAX_SIZE;
+
+            cJSON *value = NULL;
+            uint32_t valueSize;
+
+            // Paged records are not cached either
+            if (this->cache == NULL || !this->cache->Peek(key, &value))
+                err = this->read(key, &value, &valueSize);
+            if (err != ESP_OK)
+                break;
+
+            strcpy(cursor->Key, key);
+
+            bool stop = value != NULL && scan(key, value, context);
+            cJSON_Delete(value);
+            if (stop)
+            {
+                more = more || i + 1 < size;
+                break;
+            }
+        }
+
+        cursor->More = more;
+
+        free((void *)keys);
+
+        return err;
+    }
+
+    void Handle::swapKeys(char *keys, uint32_t i, uint32_t j)
+    {
+        char key[NVS_KEY_NAME_MAX_SIZE];
+
+        strcpy(key, keys + i * NVS_KEY_NAME_MAX_SIZE);
+        strcpy(keys + i * NVS_KEY_NAME_MAX_SIZE, keys + j * NVS_KEY_NAME_MAX_SIZE);
+        strcpy(keys + j * NVS_KEY_NAME_MAX_SIZE, key);
+    }
+
+    void Handle::siftKeys(char *keys, uint32_t size, uint32_t i)
+    {
+        while (true)
+        {
+            uint32_t highest = i;
+            uint32_t left = 2 * i + 1;
+            uint32_t right = 2 * i + 2;
+
+            if (left < size && strcmp(keys + left * NVS_KEY_NAME_MAX_SIZE, keys + highest * NVS_KEY_NAME_MAX_SIZE) > 0)
+                highest = left;
+            if (right < size && strcmp(keys + right * NVS_KEY_NAME_MAX_SIZE, keys + highest * NVS_KEY_NAME_MAX_SIZE) > 0)
+                highest = right;
+
+            if (highest == i)
+                return;
+
+            swapKeys(keys, i, highest);
+            i = highest;
+        }
+    }
+
+    esp_err_t Handle::remove(const char *key)
+    {
+        esp_err_t err;
+
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+
+        err = backend::EraseKey(this->handle, key);
+        if (err == ESP_OK)
+        {
+            if (this->count > 0)
+                this->count--;
+
+            err = backend::Commit(this->handle);
+        }
+        else if (err != ESP_ERR_NVS_NOT_FOUND)
+            this->counted = false;
+
+        if (err != ESP_ERR_NVS_NOT_FOUND)
+            this->generation++;
+
+        if (err == ESP_OK || err == ESP_ERR_NVS_NOT_FOUND)
+        {
+            for (Index *index = this->indexes; index != NULL; index = index->next)
+            {
+                esp_err_t indexErr = index->prune(key, NULL);
+                if (indexErr != ESP_OK)
+                {
+                    err = indexErr;
+                    break;
+                }
+            }
+        }
+
+        xSemaphoreGive(this->lock);
+
+        if (this->cache != NULL)
+            this->cache->Evict(key);
+
+        if (err == ESP_ERR_NVS_NOT_FOUND)
+            return ESP_OK;
+        else if (err != ESP_OK)
+            return err;
+
+        return ESP_OK;
+    }
+
+    esp_err_t Handle::Exists(const char *key, bool *exists)
+    {
+        esp_err_t err;
+
+        nvs_type_t type;
+
+        err = backend::FindKey(this->handle, key, &type);
+        *exists = err == ESP_OK;
+        if (err == ESP_ERR_NVS_NOT_FOUND)
+            return ESP_OK;
+        else if (err != ESP_OK)
+            return err;
+
+        return ESP_OK;
+    }
+
+    esp_err_t Handle::GetBlob(const char *key, void *value, size_t *size)
+    {
+        esp_err_t err;
+
+        err = backend::GetBlob(this->handle, key, value, size);
+        if (err == ESP_ERR_NVS_NOT_FOUND)
+        {
+            *size = 0;
+            return ESP_OK;
+        }
+        else if (err != ESP_OK)
+            return err;
+
+        return ESP_OK;
+    }
+
+    esp_err_t Handle::SetBlob(const char *key, const void *value, size_t size)
+    {
+        esp_err_t err;
+
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+
+        nvs_type_t type;
+        bool exists = backend::FindKey(this->handle, key, &type) == ESP_OK;
+
+        err = store(this->handle, key, NVS_TYPE_BLOB, (const uint8_t *)value, size);
+        if (err == ESP_OK)
+            err = backend::Commit(this->handle);
+
+        if (err != ESP_OK)
+            this->counted = false;
+        else if (!exists)
+            this->count++;
+
+        this->generation++;
+
+        xSemaphoreGive(this->lock);
+
+        return err;
+    }
+
+    Index *Handle::findIndex(const char *name)
+    {
+        for (Index *index = this->indexes; index != NULL; index = index->next)
+            if (!strcmp(index->name, name))
+                return index;
+
+        return NULL;
+    }
+
+    esp_err_t Handle::buildIndex(Index *index)
+    {
+        esp_err_t err;
+
+        err = index->clear();
         if (err != ESP_OK)
             return err;
 
+        // Collect the keys first, as writing to the partition while iterating it is not possible
+        class Keys
+        {
+        public:
+            char *List;
+            uint32_t Size;
+            uint32_t Capacity;
+        };
+
+        Keys keys = {
+            .List = NULL,
+            .Size = 0,
+            .Capacity = 0,
+        };
+
+        err = this->Find(
+            [](const char *key, void *context) -> bool
+            {
+                Keys *keys = (Keys *)context;
+
+                if (keys->Size == keys->Capacity)
+                {
+                    keys->Capacity = keys->Capacity > 0 ? keys->Capacity * 2 : 8;
+                    keys->List = (char *)realloc(keys->List, keys->Capacity * NVS_KEY_NAME_MAX_SIZE);
+                }
+
+                strcpy(keys->List + keys->Size * NVS_KEY_NAME_MAX_SIZE, key);
+                keys->Size++;
+
+                return false;
+            },
+            &keys);
+
+        for (uint32_t i = 0; err == ESP_OK && i < keys.Size; i++)
+        {
+            const char *key = keys.List + i * NVS_KEY_NAME_MAX_SIZE;
+
+            cJSON *value = NULL;
+            err = this->Get(key, &value);
+            if (err == ESP_OK && value != NULL)
+                err = index->add(key, value);
+            cJSON_Delete(value);
+        }
+
+        free((void *)keys.List);
+
+        if (err != ESP_OK)
+            return err;
+
+        // Only a complete index is trusted on the next boot
+        return index->seal();
+    }
+
+    esp_err_t Handle::AddIndex(const char *name, db_index_cb_t extract)
+    {
+        esp_err_t err;
+
+        if (this->findIndex(name) != NULL)
+            return ESP_OK;
+
+        Index *index = Index::New(name, extract);
+
+        // Indexes declared for the first time or interrupted while building are rebuilt from the records,
+        // note that indexes must be added before the namespace is written by other tasks
+        if (!index->built())
+        {
+            err = this->buildIndex(index);
+            if (err != ESP_OK)
+                return err;
+        }
+
+        index->next = this->indexes;
+        this->indexes = index;
+
         return ESP_OK;
     }
+
+    esp_err_t Handle::Lookup(const char *name, const char *term, db_find_cb_t find, void *context)
+    {
+        Index *index = this->findIndex(name);
+        if (index == NULL)
+            return ESP_ERR_NOT_FOUND;
+
+        uint32_t count;
+
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+        char *keys = index->match(term, &count);
+        xSemaphoreGive(this->lock);
+
+        for (uint32_t i = 0; i < count; i++)
+            if (find(keys + i * NVS_KEY_NAME_MAX_SIZE, context))
+                break;
+
+        free((void *)keys);
+
+        return ESP_OK;
+    }
+
+#if CONFIG_DATABASE_PROFILE
+    void Handle::profile(Operation operation, int64_t start, uint32_t allocations, esp_err_t err)
+    {
+        uint32_t elapsed = esp_timer_get_time() - start;
+        allocations = Allocations::Count() - allocations;
+
+        uint8_t bucket = 0;
+        while (bucket < LATENCY_BUCKETS - 1 && elapsed >= (2UL << bucket))
+            bucket++;
+
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+
+        OperationStats *stats = &this->operations[operation];
+        stats->Calls++;
+        if (err != ESP_OK)
+            stats->Errors++;
+        stats->Total += elapsed;
+        if (elapsed > stats->Max)
+            stats->Max = elapsed;
+        stats->Latencies[bucket]++;
+        stats->Allocations += allocations;
+
+        xSemaphoreGive(this->lock);
+    }
+#endif
+
+    esp_err_t Handle::Count(uint32_t *count)
+    {
+#if CONFIG_DATABASE_PROFILE
+        int64_t start = esp_timer_get_time();
+        uint32_t allocations = Allocations::Count();
+        esp_err_t err = this->countRecords(count);
+        this->profile(OPERATION_COUNT, start, allocations, err);
+
+        return err;
+#else
+        return this->countRecords(count);
+#endif
+    }
+
+    uint32_t Handle::Generation()
+    {
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+        uint32_t generation = this->generation;
+        xSemaphoreGive(this->lock);
+
+        return generation;
+    }
+
+    esp_err_t Handle::Get(const char *key, cJSON **value)
+    {
+#if CONFIG_DATABASE_PROFILE
+        int64_t start = esp_timer_get_time();
+        uint32_t allocations = Allocations::Count();
+        esp_err_t err = this->get(key, value);
+        this->profile(OPERATION_GET, start, allocations, err);
+
+        return err;
+#else
+        return this->get(key, value);
+#endif
+    }
+
+    esp_err_t Handle::Set(const char *key, cJSON *value)
+    {
+#if CONFIG_DATABASE_PROFILE
+        int64_t start = esp_timer_get_time();
+        uint32_t allocations = Allocations::Count();
+        esp_err_t err = this->set(key, value);
+        this->profile(OPERATION_SET, start, allocations, err);
+
+        return err;
+#else
+        return this->set(key, value);
+#endif
+    }
+
+    esp_err_t Handle::Find(db_find_cb_t find, void *context)
+    {
+#if CONFIG_DATABASE_PROFILE
+        int64_t start = esp_timer_get_time();
+        uint32_t allocations = Allocations::Count();
+        esp_err_t err = this->find(find, context);
+        this->profile(OPERATION_FIND, start, allocations, err);
+
+        return err;
+#else
+        return this->find(find, context);
+#endif
+    }
+
+    esp_err_t Handle::Scan(db_scan_cb_t scan, void *context)
+    {
+#if CONFIG_DATABASE_PROFILE
+        int64_t start = esp_timer_get_time();
+        uint32_t allocations = Allocations::Count();
+        esp_err_t err = this->scan(scan, context);
+        this->profile(OPERATION_SCAN, start, allocations, err);
+
+        return err;
+#else
+        return this->scan(scan, context);
+#endif
+    }
+
+    esp_err_t Handle::Scan(db_scan_cb_t scan, void *context, uint32_t limit, Cursor *cursor)
+    {
+#if CONFIG_DATABASE_PROFILE
+        int64_t start = esp_timer_get_time();
+        uint32_t allocations = Allocations::Count();
+        esp_err_t err = this->scan(scan, context, limit, cursor);
+        this->profile(OPERATION_SCAN, start, allocations, err);
+
+        return err;
+#else
+        return this->scan(scan, context, limit, cursor);
+#endif
+    }
+
+    esp_err_t Handle::Delete(const char *key)
+    {
+#if CONFIG_DATABASE_PROFILE
+        int64_t start = esp_timer_get_time();
+        uint32_t allocations = Allocations::Count();
+        esp_err_t err = this->remove(key);
+        this->profile(OPERATION_DELETE, start, allocations, err);
+
+        return err;
+#else
+        return this->remove(key);
+#endif
+    }
+
+    void Handle::SetSchema(const Schema *schema)
+    {
+        this->schema = schema;
+    }
+
+    void Handle::SetCache(uint32_t budget)
+    {
+        if (this->cache != NULL)
+            return;
+
+        this->cache = Cache::New(budget);
+    }
+
+    void Handle::GetCacheStats(CacheStats *stats)
+    {
+        if (this->cache == NULL)
+        {
+            memset(stats, 0, sizeof(CacheStats));
+            return;
+        }
+
+        this->cache->Stats(stats);
+    }
+
+    void Handle::GetStats(HandleStats *stats)
+    {
+        // Callbacks run inside the timed operations, so their time is included too. Operations are only
+        // profiled with CONFIG_DATABASE_PROFILE, otherwise they are left zeroed.
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+        memcpy(stats->Operations, this->operations, sizeof(this->operations));
+        stats->Records = this->count;
+        xSemaphoreGive(this->lock);
+
+        if (backend::UsedEntries(this->handle, &stats->Entries) != ESP_OK)
+            stats->Entries = 0;
+    }
+
+    uint32_t OperationStats::Percentile(uint8_t percentile) const
+    {
+        if (this->Calls == 0)
+            return 0;
+
+        // Upper bound of the bucket holding the percentile, capped by the slowest call
+        uint64_t rank = ((uint64_t)this->Calls * percentile + 99) / 100;
+        uint64_t seen = 0;
+        for (uint8_t i = 0; i < LATENCY_BUCKETS - 1; i++)
+        {
+            seen += this->Latencies[i];
+            if (seen >= rank)
+                return (2UL << i) < this->Max ? (2UL << i) : this->Max;
+        }
+
+        return this->Max;
+    }
 }
\ No newline at end of file
@@ -1,8 +1,14 @@
 #pragma once
 
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
 #include "esp_err.h"
 #include "nvs_flash.h"
 #include "cJSON.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "logger.hpp"
 
 namespace database
@@ -12,7 +18,347 @@ namespace database
     static const char *PARTITION = "database";
     static const char *DB_NAMESPACE = "system";
 
+    static const uint8_t RECORD_FORMAT = 1;       // Binary record encoding version
+    static const size_t RECORD_BUFFER_SIZE = 256; // Bytes, records up to this size are read without allocating
+
+    static const uint8_t INDEX_FORMAT = 1; // Persisted index encoding version
+    static const uint8_t JOURNAL_FORMAT = 1; // Write batch journal encoding version
+    static const char *JOURNAL_KEY = "journal";
+    static const size_t CURSOR_TOKEN_SIZE = 2 * (NVS_KEY_NAME_MAX_SIZE - 1) + 1; // Hexadecimal key, including the zero-terminator
+    static const uint8_t INDEX_BUCKETS = 32;
+    static const uint8_t INDEX_MAX_TERMS = 4; // Per record
+    static const uint8_t POOL_BUCKETS = 64;
+    static const size_t ARENA_CHUNK_SIZE = 512; // Bytes, of the first chunk, the next ones double it
+    static const uint8_t LATENCY_BUCKETS = 16; // Powers of two microseconds, the last one holds anything slower
+
     typedef bool (*db_find_cb_t)(const char *key, void *context);
+    // The value is owned by the scan and only valid during the callback
+    typedef bool (*db_scan_cb_t)(const char *key, cJSON *value, void *context);
+    // Fills terms with the values the record is indexed by, pointing into value, and returns how many there are
+    typedef uint8_t (*db_index_cb_t)(cJSON *value, const char *terms[INDEX_MAX_TERMS]);
+
+    typedef enum FieldType
+    {
+        FIELD_STRING,  // Length-prefixed c-string
+        FIELD_NUMBER,  // Zigzag varint
+        FIELD_STRINGS, // Count-prefixed array of length-prefixed c-strings
+        FIELD_OBJECT,  // Nested record
+    } FieldType;
+
+    // Schema class forward declaration
+    class Schema;
+
+    class Field
+    {
+    public:
+        const char *Name;
+        FieldType Type;
+        const Schema *Nested; // Only for FIELD_OBJECT
+    };
+
+    // Binary layout of a JSON record: a presence mask followed by the present fields in order.
+    // Fields can only be appended, so records written with older versions keep decoding.
+    class Schema
+    {
+    public:
+        uint8_t Version;
+        const Field *Fields;
+        uint8_t Size; // Up to 32 fields
+
+    public:
+        esp_err_t Encode(cJSON *src, uint8_t **dst, size_t *size) const;
+        esp_err_t Decode(const uint8_t *src, size_t size, cJSON **dst) const;
+    };
+
+    class CacheStats
+    {
+    public:
+        uint32_t Hits;
+        uint32_t Misses;
+        uint32_t Entries;
+        uint32_t Size;   // Bytes
+        uint32_t Budget; // Bytes
+    };
+
+    typedef enum Operation
+    {
+        OPERATION_GET,
+        OPERATION_SET,
+        OPERATION_DELETE,
+        OPERATION_COUNT,
+        OPERATION_FIND,
+        OPERATION_SCAN, // Full and paged
+        OPERATION_MAX,
+    } Operation;
+
+    // Heap allocations counted per task, so the ones of other tasks are never attributed to an operation.
+    // Counted through the heap hooks on the device and by wrapping the C library allocator on host builds,
+    // only with CONFIG_DATABASE_PROFILE, otherwise the count stays at zero.
+    class Allocations
+    {
+    public:
+        static void Track();
+        static uint32_t Count(); // Made by the calling task since tracking started
+    };
+
+    class OperationStats
+    {
+    public:
+        uint32_t Calls;
+        uint32_t Errors;
+        uint64_t Total;                     // Microseconds
+        uint32_t Max;                       // Microseconds
+        uint32_t Latencies[LATENCY_BUCKETS]; // Calls that took less than 2^(i+1) microseconds
+        uint64_t Allocations;               // Heap allocations made by the calling task, including callbacks
+
+    public:
+        uint32_t Percentile(uint8_t percentile) const;
+    };
+
+    class HandleStats
+    {
+    public:
+        OperationStats Operations[OPERATION_MAX];
+        uint32_t Records;
+        size_t Entries; // NVS entries used by the namespace
+    };
+
+    // Least recently used cache of parsed records bounded by a byte budget
+    class Cache
+    {
+    private:
+        class Entry
+        {
+        public:
+            char Key[NVS_KEY_NAME_MAX_SIZE];
+            cJSON *Value;
+            uint32_t Size; // Bytes
+            Entry *Prev;
+            Entry *Next;
+        };
+
+        SemaphoreHandle_t lock;
+        Entry *head; // Most recently used
+        Entry *tail; // Least recently used
+        uint32_t budget;
+        uint32_t size;
+        uint32_t entries;
+        uint32_t hits;
+        uint32_t misses;
+
+    private:
+        Entry *find(const char *key);
+        void link(Entry *entry);
+        void unlink(Entry *entry);
+        void remove(Entry *entry);
+
+    public:
+        static Cache *New(uint32_t budget);
+
+    public:
+        bool Get(const char *key, cJSON **value);
+        bool Peek(const char *key, cJSON **value); // Like Get, but neither promoting nor counted
+        void Put(const char *key, cJSON *value, uint32_t size);
+        void Evict(const char *key);
+        void Clear();
+        void Stats(CacheStats *stats);
+    };
+
+    // Position in the key order of a namespace, encoded as an opaque token for clients
+    class Cursor
+    {
+    public:
+        char Key[NVS_KEY_NAME_MAX_SIZE]; // Last visited key, empty to start from the first one
+        bool More;                       // Whether there are keys after it
+
+    public:
+        Cursor();
+        esp_err_t Decode(const char *token);
+        void Encode(char token[CURSOR_TOKEN_SIZE]) const;
+    };
+
+    class PoolStats
+    {
+    public:
+        uint32_t Strings;
+        uint32_t Size; // Bytes, including the nodes
+    };
+
+    // Process-wide set of strings that repeat across records. Interned strings are never released,
+    // so equal strings always share the same pointer and can be compared by it.
+    class Pool
+    {
+    private:
+        class String
+        {
+        public:
+            const char *Value; // Either the registered string or the bytes following the node
+            uint32_t Hash;
+            String *Next;
+        };
+
+        inline static String *buckets[POOL_BUCKETS];
+        inline static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+        inline static uint32_t strings;
+        inline static uint32_t size;
+
+    private:
+        static String *find(const char *str, uint32_t hash);
+
+    public:
+        static uint32_t Hash(const char *str); // FNV-1a
+        static const char *Intern(const char *str);
+        static void Register(const char *str); // Interns a string with static storage without copying it
+        static void Stats(PoolStats *stats);
+    };
+
+    // Bump allocator whose memory is only released all at once, chunks are never moved
+    class Arena
+    {
+    private:
+        class Chunk
+        {
+        public:
+            size_t Size; // Bytes
+            size_t Used; // Bytes
+            Chunk *Next;
+        };
+
+        Chunk *chunks; // Most recent first
+        bool external;
+
+    private:
+        static size_t header();
+
+    public:
+        Arena(bool external = false); // Chunks of external arenas are allocated in PSRAM when available
+        ~Arena();
+        Arena(const Arena &) = delete;
+        Arena &operator=(const Arena &) = delete;
+
+    public:
+        void *Allocate(size_t size);
+        void Reset(); // Releases every allocation but keeps the largest chunk for reuse
+        static char *Copy(Arena *arena, const char *str);
+        static char *Copy(Arena *arena, cJSON *item); // Of its string, NULL if there is no item
+    };
+
+    // Entities built together with the strings they point to, which live in a single arena.
+    // Entities are never destroyed one by one, so they must not be assigned nor deleted.
+    template <typename T>
+    class ResultSet
+    {
+    private:
+        Arena arena;
+        T *items;
+        uint32_t size;
+        uint32_t capacity;
+
+    public:
+        ResultSet();
+        ~ResultSet();
+        ResultSet(const ResultSet &) = delete;
+        ResultSet &operator=(const ResultSet &) = delete;
+
+    public:
+        void Reserve(uint32_t capacity);
+        T *Add(cJSON *src);
+        uint32_t Size() const;
+        T &operator[](uint32_t i);
+    };
+
+    template <typename T>
+    ResultSet<T>::ResultSet()
+    {
+        this->items = NULL;
+        this->size = 0;
+        this->capacity = 0;
+    }
+
+    template <typename T>
+    ResultSet<T>::~ResultSet()
+    {
+        // Entity strings are released with the arena
+        free((void *)this->items);
+    }
+
+    template <typename T>
+    void ResultSet<T>::Reserve(uint32_t capacity)
+    {
+        if (capacity <= this->capacity)
+            return;
+
+        // Entities only point into the arena, so they can be moved bitwise
+        T *items = (T *)realloc((void *)this->items, capacity * sizeof(T));
+        if (items == NULL)
+            ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+
+        this->items = items;
+        this->capacity = capacity;
+    }
+
+    template <typename T>
+    T *ResultSet<T>::Add(cJSON *src)
+    {
+        if (this->size == this->capacity)
+            this->Reserve(this->capacity > 0 ? this->capacity * 2 : 8);
+
+        T *item = new (&this->items[this->size]) T(src, &this->arena);
+        this->size++;
+
+        return item;
+    }
+
+    template <typename T>
+    uint32_t ResultSet<T>::Size() const
+    {
+        return this->size;
+    }
+
+    template <typename T>
+    T &ResultSet<T>::operator[](uint32_t i)
+    {
+        return this->items[i];
+    }
+
+    // Handle class forward declaration
+    class Handle;
+
+    // In-memory multi-valued secondary index of a namespace, persisted in its own namespace.
+    // Terms are written before the records that contain them, so it can only hold stale keys,
+    // which is why matches must always be verified against the record.
+    class Index
+    {
+    private:
+        class Posting
+        {
+        public:
+            char *Term;
+            char Key[NVS_KEY_NAME_MAX_SIZE];
+            uint32_t Hash;
+            Posting *Next;
+        };
+
+        nvs_handle_t handle;
+        const char *name;
+        db_index_cb_t extract;
+        Posting *buckets[INDEX_BUCKETS];
+        Index *next;
+
+    private:
+        static Index *New(const char *name, db_index_cb_t extract);
+        esp_err_t load();
+        esp_err_t persist(uint32_t hash);
+        bool built();
+        esp_err_t add(const char *key, cJSON *value);
+        esp_err_t prune(const char *key, cJSON *value);
+        esp_err_t clear();
+        esp_err_t seal();
+        char *match(const char *term, uint32_t *count);
+
+        friend class Handle;
+        friend class WriteBatch;
+    };
 
     // Database class forward declaration
     class Database;
@@ -20,18 +366,114 @@ namespace database
     class Handle
     {
     private:
+        class Migration
+        {
+        public:
+            char Key[NVS_KEY_NAME_MAX_SIZE];
+            Migration *Next;
+        };
+
         nvs_handle_t handle;
         const char *nmspace;
+        const Schema *schema;
+        Cache *cache;
+        SemaphoreHandle_t lock;
+        uint32_t iterators;
+        Migration *migrations;
+        Index *indexes;
+        uint32_t count;
+        bool counted;        // Whether count can be trusted
+        uint32_t generation; // Bumped on every write, so readers can tell whether records changed
+        OperationStats operations[OPERATION_MAX];
+        Handle *next;
+
+    private:
+        esp_err_t getText(const char *key, cJSON **value, uint32_t *size);
+        esp_err_t getRecord(const char *key, cJSON **value, uint32_t *size);
+        esp_err_t read(const char *key, cJSON **value, uint32_t *size);
+        esp_err_t serialize(cJSON *value, nvs_type_t *type, uint8_t **data, size_t *size);
+        static esp_err_t store(nvs_handle_t handle, const char *key, nvs_type_t type, const uint8_t *data, size_t size);
+        esp_err_t write(const char *key, cJSON *value, uint32_t *size);
+        esp_err_t migrate(const char *key, cJSON *value);
+        void beginIteration();
+        void endIteration();
+        Index *findIndex(const char *name);
+        esp_err_t buildIndex(Index *index);
+#if CONFIG_DATABASE_PROFILE
+        void profile(Operation operation, int64_t start, uint32_t allocations, esp_err_t err);
+#endif
+        esp_err_t countRecords(uint32_t *count);
+        esp_err_t get(const char *key, cJSON **value);
+        esp_err_t set(const char *key, cJSON *value);
+        esp_err_t find(db_find_cb_t find, void *context);
+        esp_err_t scan(db_scan_cb_t scan, void *context);
+        esp_err_t scan(db_scan_cb_t scan, void *context, uint32_t limit, Cursor *cursor);
+        static void swapKeys(char *keys, uint32_t i, uint32_t j);
+        static void siftKeys(char *keys, uint32_t size, uint32_t i); // Down the max-heap of page keys
+        esp_err_t remove(const char *key);
 
     public:
         esp_err_t Drop();
         esp_err_t Count(uint32_t *count);
+        uint32_t Generation(); // Only comparable within the same boot
         esp_err_t Get(const char *key, cJSON **value);
         esp_err_t Set(const char *key, cJSON *value);
         esp_err_t Find(db_find_cb_t find, void *context);
+        esp_err_t Scan(db_scan_cb_t scan, void *context);
+        esp_err_t Scan(db_scan_cb_t scan, void *context, uint32_t limit, Cursor *cursor);
         esp_err_t Delete(const char *key);
+        esp_err_t Exists(const char *key, bool *exists);
+        esp_err_t GetBlob(const char *key, void *value, size_t *size);
+        esp_err_t SetBlob(const char *key, const void *value, size_t size);
+        esp_err_t AddIndex(const char *name, db_index_cb_t extract);
+        esp_err_t Lookup(const char *name, const char *term, db_find_cb_t find, void *context);
+        void SetSchema(const Schema *schema);
+        void SetCache(uint32_t budget);
+        void GetCacheStats(CacheStats *stats);
+        void GetStats(HandleStats *stats);
 
         friend class Database;
+        friend class WriteBatch;
+    };
+
+    // Puts and deletes across handles applied all-or-nothing with a single commit per handle.
+    // Batches of several keys are journaled before being applied, so an interrupted batch is rolled forward.
+    // A batch that cannot be rolled forward either has its journal dropped and its error returned by Commit.
+    class WriteBatch
+    {
+    private:
+        class Operation
+        {
+        public:
+            Handle *Target;
+            char Key[NVS_KEY_NAME_MAX_SIZE];
+            cJSON *Value; // NULL for deletes and blobs
+            nvs_type_t Type; // NVS_TYPE_ANY for deletes
+            uint8_t *Data;
+            size_t Size; // Bytes
+            Operation *Next;
+        };
+
+        Operation *operations;
+        Operation *last;
+        bool journaled; // Whether the journal of the batch is stored
+
+    private:
+        void stage(Handle *handle, const char *key, cJSON *value);
+        void clear();
+        bool superseded(Operation *operation);
+        esp_err_t writeJournal(size_t size);
+        esp_err_t apply();
+
+    public:
+        WriteBatch();
+        ~WriteBatch();
+
+    public:
+        void Set(Handle *handle, const char *key, cJSON *value);
+        void SetBlob(Handle *handle, const char *key, const void *value, size_t size);
+        void Delete(Handle *handle, const char *key);
+        esp_err_t Commit();
     };
 
     class Database
@@ -39,9 +481,12 @@ namespace database
     private:
         logger::Logger *logger;
         database::Handle *db;
+        database::Handle *handles;
+        SemaphoreHandle_t journal;
 
     private:
         void reset();
+        esp_err_t replay();
 
     public:
         inline static Database *Instance;
@@ -51,5 +496,7 @@ namespace database
         void Info(nvs_stats_t *info);
         Handle *Open(const char *nmspace);
         void ScheduleReset();
+
+        friend class WriteBatch;
     };
 }
\ No newline at end of file
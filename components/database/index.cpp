@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include "esp_err.h"
+#include "nvs.h"
+#include "cJSON.h"
+#include "backend.hpp"
+#include "database.hpp"
+
+namespace database
+{
+    // Marks the index namespace as fully built, hexadecimal bucket keys can never collide with it
+    static const char *INDEX_BUILT_KEY = "built";
+
+    Index *Index::New(const char *name, db_index_cb_t extract)
+    {
+        Index *index = new Index();
+
+        index->name = name;
+        index->extract = extract;
+        memset(index->buckets, 0, sizeof(index->buckets));
+        index->next = NULL;
+
+        ESP_ERROR_CHECK(backend::Open(PARTITION, index->name, &index->handle));
+        ESP_ERROR_CHECK(index->load());
+
+        return index;
+    }
+
+    esp_err_t Index::load()
+    {
+        esp_err_t err;
+
+        nvs_entry_info_t itemInfo;
+        backend::iterator_t iter = NULL;
+
+        err = backend::EntryFind(PARTITION, this->name, NVS_TYPE_BLOB, &iter);
+        if (err == ESP_ERR_NVS_NOT_FOUND)
+            return ESP_OK;
+        else if (err != ESP_OK)
+            return err;
+
+        while (err == ESP_OK)
+        {
+            backend::EntryInfo(iter, &itemInfo);
+
+            size_t size;
+            err = backend::GetBlob(this->handle, itemInfo.key, NULL, &size);
+            if (err != ESP_OK)
+                break;
+
+            char *bucket = (char *)malloc(size);
+            err = backend::GetBlob(this->handle, itemInfo.key, bucket, &size);
+            if (err != ESP_OK)
+            {
+                free((void *)bucket);
+                break;
+            }
+
+            // Buckets are a sequence of zero-terminated term and key pairs
+            const char *cursor = bucket;
+            while (cursor < bucket + size)
+            {
+                const char *term = cursor;
+                cursor += strnlen(term, bucket + size - term) + 1;
+                const char *key = cursor;
+                cursor += strnlen(key, bucket + size - key) + 1;
+                if (cursor > bucket + size || strlen(key) >= NVS_KEY_NAME_MAX_SIZE)
+                    break;
+
+                Posting *posting = new Posting();
+                posting->Term = strdup(term);
+                strcpy(posting->Key, key);
+                posting->Hash = Pool::Hash(term);
+                posting->Next = this->buckets[posting->Hash % INDEX_BUCKETS];
+                this->buckets[posting->Hash % INDEX_BUCKETS] = posting;
+            }
+
+            free((void *)bucket);
+            err = backend::EntryNext(&iter);
+        }
+        backend::ReleaseIterator(iter);
+
+        if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)
+            return err;
+
+        return ESP_OK;
+    }
+
+    esp_err_t Index::persist(uint32_t hash)
+    {
+        esp_err_t err;
+
+        char key[NVS_KEY_NAME_MAX_SIZE];
+        snprintf(key, sizeof(key), "%08" PRIx32, hash);
+
+        // Terms whose hashes collide share the bucket
+        size_t size = 0;
+        for (Posting *posting = this->buckets[hash % INDEX_BUCKETS]; posting != NULL; posting = posting->Next)
+            if (posting->Hash == hash)
+                size += strlen(posting->Term) + 1 + strlen(posting->Key) + 1;
+
+        if (size == 0)
+        {
+            err = backend::EraseKey(this->handle, key);
+            if (err == ESP_ERR_NVS_NOT_FOUND)
+                return ESP_OK;
+        }
+        else
+        {
+            char *bucket = (char *)malloc(size);
+            char *cursor = bucket;
+            for (Posting *posting = this->buckets[hash % INDEX_BUCKETS]; posting != NULL; posting = posting->Next)
+            {
+                if (posting->Hash != hash)
+                    continue;
+
+                cursor = stpcpy(cursor, posting->Term) + 1;
+                cursor = stpcpy(cursor, posting->Key) + 1;
+            }
+
+            err = backend::SetBlob(this->handle, key, bucket, size);
+            free((void *)bucket);
+        }
+        if (err != ESP_OK)
+            return err;
+
+        return backend::Commit(this->handle);
+    }
+
+    bool Index::built()
+    {
+        uint8_t format;
+        if (backend::GetU8(this->handle, INDEX_BUILT_KEY, &format) != ESP_OK)
+            return false;
+
+        return format == INDEX_FORMAT;
+    }
+
+    esp_err_t Index::add(const char *key, cJSON *value)
+    {
+        esp_err_t err;
+
+        const char *terms[INDEX_MAX_TERMS];
+        uint8_t count = this->extract(value, terms);
+
+        for (uint8_t i = 0; i < count; i++)
+        {
+            uint32_t termHash = Pool::Hash(terms[i]);
+
+            Posting *posting = this->buckets[termHash % INDEX_BUCKETS];
+            while (posting != NULL && (strcmp(posting->Key, key) || strcmp(posting->Term, terms[i])))
+                posting = posting->Next;
+
+            // Already indexed
+            if (posting != NULL)
+                continue;
+
+            posting = new Posting();
+            posting->Term = strdup(terms[i]);
+            strcpy(posting->Key, key);
+            posting->Hash = termHash;
+            posting->Next = this->buckets[termHash % INDEX_BUCKETS];
+            this->buckets[termHash % INDEX_BUCKETS] = posting;
+
+            err = this->persist(termHash);
+            if (err != ESP_OK)
+                return err;
+        }
+
+        return ESP_OK;
+    }
+
+    esp_err_t Index::prune(const char *key, cJSON *value)
+    {
+        esp_err_t err;
+
+        // Without a value every term of the key is stale
+        const char *terms[INDEX_MAX_TERMS];
+        uint8_t count = value != NULL ? this->extract(value, terms) : 0;
+
+        for (uint8_t bucket = 0; bucket < INDEX_BUCKETS; bucket++)
+        {
+            Posting **link = &this->buckets[bucket];
+            while (*link != NULL)
+            {
+                Posting *posting = *link;
+
+                bool stale = !strcmp(posting->Key, key);
+                for (uint8_t i = 0; stale && i < count; i++)
+                    stale = strcmp(posting->Term, terms[i]);
+
+                if (!stale)
+                {
+                    link = &posting->Next;
+                    continue;
+                }
+
+                *link = posting->Next;
+                uint32_t termHash = posting->Hash;
+                free((void *)posting->Term);
+                delete posting;
+
+                err = this->persist(termHash);
+                if (err != ESP_OK)
+                    return err;
+            }
+        }
+
+        return ESP_OK;
+    }
+
+    esp_err_t Index::clear()
+    {
+        esp_err_t err;
+
+        for (uint8_t bucket = 0; bucket < INDEX_BUCKETS; bucket++)
+        {
+            while (this->buckets[bucket] != NULL)
+            {
+                Posting *posting = this->buckets[bucket];
+                this->buckets[bucket] = posting->Next;
+                free((void *)posting->Term);
+                delete posting;
+            }
+        }
+
+        err = backend::EraseAll(this->handle);
+        if (err != ESP_OK)
+            return err;
+
+        return backend::Commit(this->handle);
+    }
+
+    esp_err_t Index::seal()
+    {
+        esp_err_t err;
+
+        err = backend::SetU8(this->handle, INDEX_BUILT_KEY, INDEX_FORMAT);
+        if (err != ESP_OK)
+            return err;
+
+        return backend::Commit(this->handle);
+    }
+
+    char *Index::match(const char *term, uint32_t *count)
+    {
+        uint32_t termHash = Pool::Hash(term);
+
+        *count = 0;
+        for (Posting *posting = this->buckets[termHash % INDEX_BUCKETS]; posting != NULL; posting = posting->Next)
+            if (posting->Hash == termHash && !strcmp(posting->Term, term))
+                (*count)++;
+
+        if (*count < 1)
+            return NULL;
+
+        // Copy the keys out so the caller can read the records without holding the handle lock
+        char *keys = (char *)malloc(*count * NVS_KEY_NAME_MAX_SIZE);
+        char *cursor = keys;
+        for (Posting *posting = this->buckets[termHash % INDEX_BUCKETS]; posting != NULL; posting = posting->Next)
+        {
+            if (posting->Hash == termHash && !strcmp(posting->Term, term))
+            {
+                strcpy(cursor, posting->Key);
+                cursor += NVS_KEY_NAME_MAX_SIZE;
+            }
+        }
+
+        return keys;
+    }
+}
\ No newline at end of file
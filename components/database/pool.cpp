@@ -0,0 +1,111 @@
+#include <stdlib.h>
+#include <string.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "database.hpp"
+
+namespace database
+{
+    uint32_t Pool::Hash(const char *str)
+    {
+        // FNV-1a
+        uint32_t hash = 2166136261UL;
+        for (; *str != '\0'; str++)
+            hash = (hash ^ (uint8_t)*str) * 16777619UL;
+
+        return hash;
+    }
+
+    Pool::String *Pool::find(const char *str, uint32_t hash)
+    {
+        for (String *string = buckets[hash % POOL_BUCKETS]; string != NULL; string = string->Next)
+            if (string->Hash == hash && !strcmp(string->Value, str))
+                return string;
+
+        return NULL;
+    }
+
+    const char *Pool::Intern(const char *str)
+    {
+        if (str == NULL)
+            return NULL;
+
+        uint32_t hash = Pool::Hash(str);
+
+        // Strings are looked up under a spinlock, which can be taken before the scheduler starts
+        taskENTER_CRITICAL(&lock);
+        String *string = find(str, hash);
+        taskEXIT_CRITICAL(&lock);
+
+        if (string != NULL)
+            return string->Value;
+
+        // Allocate outside of the critical section, the node and its bytes at once
+        size_t length = strlen(str) + 1;
+        String *copy = (String *)malloc(sizeof(String) + length);
+        if (copy == NULL)
+            ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+
+        memcpy(copy + 1, str, length);
+        copy->Value = (const char *)(copy + 1);
+        copy->Hash = hash;
+
+        // Another task could have interned it meanwhile
+        taskENTER_CRITICAL(&lock);
+        string = find(str, hash);
+        if (string == NULL)
+        {
+            copy->Next = buckets[hash % POOL_BUCKETS];
+            buckets[hash % POOL_BUCKETS] = copy;
+            strings++;
+            size += sizeof(String) + length;
+            string = copy;
+            copy = NULL;
+        }
+        taskEXIT_CRITICAL(&lock);
+
+        free((void *)copy);
+
+        return string->Value;
+    }
+
+    void Pool::Register(const char *str)
+    {
+        uint32_t hash = Pool::Hash(str);
+
+        String *node = (String *)malloc(sizeof(String));
+        if (node == NULL)
+            ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+
+        node->Value = str;
+        node->Hash = hash;
+
+        taskENTER_CRITICAL(&lock);
+        String *string = find(str, hash);
+        if (string == NULL)
+        {
+            node->Next = buckets[hash % POOL_BUCKETS];
+            buckets[hash % POOL_BUCKETS] = node;
+            strings++;
+            size += sizeof(String);
+        }
+        taskEXIT_CRITICAL(&lock);
+
+        if (string == NULL)
+            return;
+
+        free((void *)node);
+
+        // Registered strings are compared by pointer, so they cannot have been interned as a copy before
+        if (string->Value != str)
+            ESP_ERROR_CHECK(ESP_ERR_INVALID_STATE);
+    }
+
+    void Pool::Stats(PoolStats *stats)
+    {
+        taskENTER_CRITICAL(&lock);
+        stats->Strings = strings;
+        stats->Size = size;
+        taskEXIT_CRITICAL(&lock);
+    }
+}
\ No newline at end of file
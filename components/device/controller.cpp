@@ -1,5 +1,9 @@
 #include <string.h>
 #include "esp_err.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "cJSON.h"
 #include "logger.hpp"
 #include "database.hpp"
@@ -12,6 +16,8 @@ namespace device
         this->Name = NULL;
         this->Type = NULL;
         this->Subtype = NULL;
+        this->Kind = NULL;
+        this->Slot = NO_SLOT;
         this->Protocol = 0;
         memset(&this->Context, 0, sizeof(union Context));
         this->Emoji = NULL;
@@ -24,85 +30,72 @@ namespace device
                    const char *creator, time_t createdAt)
     {
         this->Name = strdup(name);
-        this->Type = strdup(type);
-        this->Subtype = strdup(subtype);
+        this->Type = database::Pool::Intern(type);
+        this->Subtype = database::Pool::Intern(subtype);
+        this->Kind = DeviceKind::Find(this->Subtype);
+        this->Slot = NO_SLOT;
         this->Protocol = protocol;
 
-        if (!strcmp(subtype, Subtypes::Button))
-        {
-            this->Context.Button.Command = strdup(context.Button.Command);
-            this->Context.Button.Emoji = strdup(context.Button.Emoji);
-        }
-        else if (!strcmp(subtype, Subtypes::Bistate))
-        {
-            this->Context.Bistate.Identifier1 = strdup(context.Bistate.Identifier1);
-            this->Context.Bistate.Emoji1 = strdup(context.Bistate.Emoji1);
-            this->Context.Bistate.Identifier2 = strdup(context.Bistate.Identifier2);
-            this->Context.Bistate.Emoji2 = strdup(context.Bistate.Emoji2);
-            this->Context.Bistate.State = context.Bistate.State;
-        }
-        else
-            memset(&this->Context, 0, sizeof(union Context));
+        memset(&this->Context, 0, sizeof(union Context));
+        if (this->Kind != NULL)
+            this->Kind->Copy(&context, &this->Context);
 
         this->Emoji = strdup(emoji);
-        this->Creator = strdup(creator);
+        this->Creator = database::Pool::Intern(creator);
         this->CreatedAt = createdAt;
     }
 
-    Device::Device(cJSON *src)
+    Device::Device(cJSON *src, database::Arena *arena)
     {
-        this->Name = strdup(cJSON_GetObjectItem(src, "name")->valuestring);
-        this->Type = strdup(cJSON_GetObjectItem(src, "type")->valuestring);
-        this->Subtype = strdup(cJSON_GetObjectItem(src, "subtype")->valuestring);
+        this->Name = database::Arena::Copy(arena, cJSON_GetObjectItem(src, "name"));
+        this->Type = database::Pool::Intern(cJSON_GetObjectItem(src, "type")->valuestring);
+        this->Subtype = database::Pool::Intern(cJSON_GetObjectItem(src, "subtype")->valuestring);
+        this->Kind = DeviceKind::Find(this->Subtype);
+        this->Slot = NO_SLOT;
         this->Protocol = cJSON_GetObjectItem(src, "protocol")->valueint;
 
-        cJSON *context = cJSON_GetObjectItem(src, "context");
-        if (!strcmp(this->Subtype, Subtypes::Button))
-        {
-            this->Context.Button.Command = strdup(cJSON_GetObjectItem(context, "command")->valuestring);
-            this->Context.Button.Emoji = strdup(cJSON_GetObjectItem(context, "emoji")->valuestring);
-        }
-        else if (!strcmp(this->Subtype, Subtypes::Bistate))
-        {
-            this->Context.Bistate.Identifier1 = strdup(cJSON_GetObjectItem(context, "identifier1")->valuestring);
-            this->Context.Bistate.Emoji1 = strdup(cJSON_GetObjectItem(context, "emoji1")->valuestring);
-            this->Context.Bistate.Identifier2 = strdup(cJSON_GetObjectItem(context, "identifier2")->valuestring);
-            this->Context.Bistate.Emoji2 = strdup(cJSON_GetObjectItem(context, "emoji2")->valuestring);
-            this->Context.Bistate.State = cJSON_GetObjectItem(context, "state")->valueint;
-        }
-        else
-            memset(&this->Context, 0, sizeof(union Context));
+        memset(&this->Context, 0, sizeof(union Context));
+        if (this->Kind != NULL)
+            this->Kind->Decode(cJSON_GetObjectItem(src, "context"), &this->Context, arena);
 
-        this->Emoji = strdup(cJSON_GetObjectItem(src, "emoji")->valuestring);
-        this->Creator = strdup(cJSON_GetObjectItem(src, "creator")->valuestring);
+        this->Emoji = database::Arena::Copy(arena, cJSON_GetObjectItem(src, "emoji"));
+        this->Creator = database::Pool::Intern(cJSON_GetObjectItem(src, "creator")->valuestring);
         this->CreatedAt = cJSON_GetObjectItem(src, "created_at")->valueint;
     }
 
+    Device::Device(Device &&other)
+    {
+        // Take over the strings of other, which is left empty
+        this->Name = other.Name;
+        this->Type = other.Type;
+        this->Subtype = other.Subtype;
+        this->Kind = other.Kind;
+        this->Slot = other.Slot;
+        this->Protocol = other.Protocol;
+        this->Context = other.Context;
+        this->Emoji = other.Emoji;
+        this->Creator = other.Creator;
+        this->CreatedAt = other.CreatedAt;
+
+        other.Name = NULL;
+        other.Type = NULL;
+        other.Subtype = NULL;
+        other.Kind = NULL;
+        other.Slot = NO_SLOT;
+        memset(&other.Context, 0, sizeof(union Context));
+        other.Emoji = NULL;
+        other.Creator = NULL;
+    }
+
     Device::~Device()
     {
         free((void *)this->Name);
-        free((void *)this->Type);
 
-        if (this->Subtype != NULL)
-        {
-            if (!strcmp(this->Subtype, Subtypes::Button))
-            {
-                free((void *)this->Context.Button.Command);
-                free((void *)this->Context.Button.Emoji);
-            }
-            else if (!strcmp(this->Subtype, Subtypes::Bistate))
-            {
-                free((void *)this->Context.Bistate.Identifier1);
-                free((void *)this->Context.Bistate.Emoji1);
-                free((void *)this->Context.Bistate.Identifier2);
-                free((void *)this->Context.Bistate.Emoji2);
-            }
-        }
+        if (this->Kind != NULL)
+            this->Kind->Free(&this->Context);
         memset(&this->Context, 0, sizeof(union Context));
 
-        free((void *)this->Subtype);
         free((void *)this->Emoji);
-        free((void *)this->Creator);
     }
 
     Device &Device::operator=(const Device &other)
@@ -111,57 +104,65 @@ namespace device
             return *this;
 
         free((void *)this->Name);
-        free((void *)this->Type);
 
-        if (this->Subtype != NULL)
-        {
-            if (!strcmp(this->Subtype, Subtypes::Button))
-            {
-                free((void *)this->Context.Button.Command);
-                free((void *)this->Context.Button.Emoji);
-            }
-            else if (!strcmp(this->Subtype, Subtypes::Bistate))
-            {
-                free((void *)this->Context.Bistate.Identifier1);
-                free((void *)this->Context.Bistate.Emoji1);
-                free((void *)this->Context.Bistate.Identifier2);
-                free((void *)this->Context.Bistate.Emoji2);
-            }
-        }
+        if (this->Kind != NULL)
+            this->Kind->Free(&this->Context);
         memset(&this->Context, 0, sizeof(union Context));
 
-        free((void *)this->Subtype);
         free((void *)this->Emoji);
-        free((void *)this->Creator);
 
         this->Name = strdup(other.Name);
-        this->Type = strdup(other.Type);
-        this->Subtype = strdup(other.Subtype);
+        this->Type = other.Type;
+        this->Subtype = other.Subtype;
+        this->Kind = other.Kind;
+        this->Slot = other.Slot;
         this->Protocol = other.Protocol;
 
-        if (!strcmp(other.Subtype, Subtypes::Button))
-        {
-            this->Context.Button.Command = strdup(other.Context.Button.Command);
-            this->Context.Button.Emoji = strdup(other.Context.Button.Emoji);
-        }
-        else if (!strcmp(other.Subtype, Subtypes::Bistate))
-        {
-            this->Context.Bistate.Identifier1 = strdup(other.Context.Bistate.Identifier1);
-            this->Context.Bistate.Emoji1 = strdup(other.Context.Bistate.Emoji1);
-            this->Context.Bistate.Identifier2 = strdup(other.Context.Bistate.Identifier2);
-            this->Context.Bistate.Emoji2 = strdup(other.Context.Bistate.Emoji2);
-            this->Context.Bistate.State = other.Context.Bistate.State;
-        }
-        else
-            memset(&this->Context, 0, sizeof(union Context));
+        if (this->Kind != NULL)
+            this->Kind->Copy(&other.Context, &this->Context);
 
         this->Emoji = strdup(other.Emoji);
-        this->Creator = strdup(other.Creator);
+        this->Creator = other.Creator;
         this->CreatedAt = other.CreatedAt;
 
         return *this;
     }
 
+    Device &Device::operator=(Device &&other)
+    {
+        if (this == &other)
+            return *this;
+
+        free((void *)this->Name);
+
+        if (this->Kind != NULL)
+            this->Kind->Free(&this->Context);
+
+        free((void *)this->Emoji);
+
+        this->Name = other.Name;
+        this->Type = other.Type;
+        this->Subtype = other.Subtype;
+        this->Kind = other.Kind;
+        this->Slot = other.Slot;
+        this->Protocol = other.Protocol;
+        this->Context = other.Context;
+        this->Emoji = other.Emoji;
+        this->Creator = other.Creator;
+        this->CreatedAt = other.CreatedAt;
+
+        other.Name = NULL;
+        other.Type = NULL;
+        other.Subtype = NULL;
+        other.Kind = NULL;
+        other.Slot = NO_SLOT;
+        memset(&other.Context, 0, sizeof(union Context));
+        other.Emoji = NULL;
+        other.Creator = NULL;
+
+        return *this;
+    }
+
     cJSON *Device::JSON()
     {
         cJSON *root = cJSON_CreateObject();
@@ -172,19 +173,8 @@ namespace device
         cJSON_AddNumberToObject(root, "protocol", this->Protocol);
 
         cJSON *context = cJSON_AddObjectToObject(root, "context");
-        if (!strcmp(this->Subtype, Subtypes::Button))
-        {
-            cJSON_AddStringToObject(context, "command", this->Context.Button.Command);
-            cJSON_AddStringToObject(context, "emoji", this->Context.Button.Emoji);
-        }
-        else if (!strcmp(this->Subtype, Subtypes::Bistate))
-        {
-            cJSON_AddStringToObject(context, "identifier1", this->Context.Bistate.Identifier1);
-            cJSON_AddStringToObject(context, "emoji1", this->Context.Bistate.Emoji1);
-            cJSON_AddStringToObject(context, "identifier2", this->Context.Bistate.Identifier2);
-            cJSON_AddStringToObject(context, "emoji2", this->Context.Bistate.Emoji2);
-            cJSON_AddNumberToObject(context, "state", this->Context.Bistate.State);
-        }
+        if (this->Kind != NULL)
+            this->Kind->Encode(&this->Context, context);
 
         cJSON_AddStringToObject(root, "emoji", this->Emoji);
         cJSON_AddStringToObject(root, "creator", this->Creator);
@@ -193,6 +183,77 @@ namespace device
         return root;
     }
 
+    Slots::Slots()
+    {
+        this->Words = NULL;
+        this->Size = 0;
+    }
+
+    Slots::~Slots()
+    {
+        free((void *)this->Words);
+    }
+
+    Slots::Slots(const Slots &other)
+    {
+        this->Words = NULL;
+        this->Size = 0;
+        *this = other;
+    }
+
+    Slots &Slots::operator=(const Slots &other)
+    {
+        if (this == &other)
+            return *this;
+
+        free((void *)this->Words);
+        this->Words = NULL;
+        this->Size = 0;
+
+        if (other.Size == 0)
+            return *this;
+
+        this->Words = (uint32_t *)malloc(other.Size * sizeof(uint32_t));
+        if (this->Words == NULL)
+            ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+
+        memcpy(this->Words, other.Words, other.Size * sizeof(uint32_t));
+        this->Size = other.Size;
+
+        return *this;
+    }
+
+    void Slots::Add(uint16_t slot)
+    {
+        if (slot == NO_SLOT)
+            return;
+
+        if (slot / 32 >= this->Size)
+        {
+            uint16_t size = slot / 32 + 1;
+            uint32_t *words = (uint32_t *)realloc((void *)this->Words, size * sizeof(uint32_t));
+            if (words == NULL)
+                ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+
+            memset(&words[this->Size], 0, (size - this->Size) * sizeof(uint32_t));
+            this->Words = words;
+            this->Size = size;
+        }
+
+        this->Words[slot / 32] |= 1UL << (slot % 32);
+    }
+
+    void Slots::Remove(uint16_t slot)
+    {
+        if (slot != NO_SLOT && slot / 32 < this->Size)
+            this->Words[slot / 32] &= ~(1UL << (slot % 32));
+    }
+
+    bool Slots::Has(uint16_t slot) const
+    {
+        return slot != NO_SLOT && slot / 32 < this->Size && (this->Words[slot / 32] & (1UL << (slot % 32)));
+    }
+
     bool Device::Equals(const char *name) const
     {
         return !strcmp(this->Name, name);
@@ -217,11 +278,275 @@ namespace device
 
         // Inject dependencies
         Instance->logger = logger;
+
+        // Types and subtypes must be registered before any device is built
+        database::Pool::Register(Types::Sensor);
+        database::Pool::Register(Types::Actuator);
+        database::Pool::Register(Subtypes::Button);
+        database::Pool::Register(Subtypes::Bistate);
+
+        Instance->states = NULL;
+        Instance->generation = 0;
+        Instance->flushDelay = STATE_FLUSH_DELAY;
+
+        Instance->lock = xSemaphoreCreateMutex();
+        if (!Instance->lock)
+            ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+
+        Instance->writer = xSemaphoreCreateMutex();
+        if (!Instance->writer)
+            ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+
         Instance->db = database->Open(DB_NAMESPACE);
+        Instance->db->SetSchema(&DB_SCHEMA);
+        Instance->db->SetCache(DB_CACHE_SIZE);
+        ESP_ERROR_CHECK(Instance->db->AddIndex(
+            DB_INDEX_IDENTIFIERS,
+            [](cJSON *value, const char *terms[database::INDEX_MAX_TERMS]) -> uint8_t
+            {
+                if (strcmp(cJSON_GetObjectItem(value, "type")->valuestring, Types::Sensor))
+                    return 0;
+
+                const DeviceKind *kind = DeviceKind::Find(cJSON_GetObjectItem(value, "subtype")->valuestring);
+                if (kind == NULL || kind->Identifiers == NULL)
+                    return 0;
+
+                return kind->Identifiers(cJSON_GetObjectItem(value, "context"), terms);
+            }));
+
+        Instance->stateDb = database->Open(DB_STATE_NAMESPACE);
+        Instance->loadStates();
+
+        Instance->slots = NULL;
+        Instance->hashes = NULL;
+        Instance->buckets = NULL;
+        Instance->chains = NULL;
+        Instance->capacity = 0;
+        Instance->top = 0;
+        Instance->loadSlots();
+
+        // Create state flusher task
+        xTaskCreatePinnedToCore(Instance->taskFunc, "Device", 4 * 1024, NULL, 5, &Instance->taskHandle, tskNO_AFFINITY);
+
+        // Do not lose pending states on restarts
+        ESP_ERROR_CHECK(esp_register_shutdown_handler([]()
+                                                      { Instance->Flush(); }));
 
         return Instance;
     }
 
+    void Controller::taskFunc(void *args)
+    {
+        while (1)
+        {
+            // Wait for the first state update
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+            // Wait for updates to settle, as remotes repeat each frame several times
+            TickType_t start = xTaskGetTickCount();
+            while (ulTaskNotifyTake(pdTRUE, Instance->flushDelay) > 0)
+                if (xTaskGetTickCount() - start >= STATE_FLUSH_MAX_DELAY)
+                    break;
+
+            Instance->Flush();
+        }
+    }
+
+    void Controller::loadStates()
+    {
+        ESP_ERROR_CHECK(this->stateDb->Find(
+            [](const char *key, void *context) -> bool
+            {
+                StateRecord record;
+                size_t size = sizeof(StateRecord);
+                ESP_ERROR_CHECK(Instance->stateDb->GetBlob(key, &record, &size));
+                if (size != sizeof(StateRecord))
+                    return false;
+
+                State *state = new State();
+                strcpy(state->Name, key);
+                state->Value = record.State;
+                state->Dirty = false;
+                state->Next = Instance->states;
+                Instance->states = state;
+
+                return false;
+            },
+            NULL));
+    }
+
+    Controller::State *Controller::findState(const char *name)
+    {
+        for (State *state = this->states; state != NULL; state = state->Next)
+            if (!strcmp(state->Name, name))
+                return state;
+
+        return NULL;
+    }
+
+    void Controller::removeState(const char *name)
+    {
+        State **link = &this->states;
+        while (*link != NULL && strcmp((*link)->Name, name))
+            link = &(*link)->Next;
+
+        if (*link == NULL)
+            return;
+
+        State *state = *link;
+        *link = state->Next;
+        delete state;
+    }
+
+    void Controller::loadSlots()
+    {
+        // Slots are given in key order on every boot, so they are only stable while running
+        ESP_ERROR_CHECK(this->db->Find(
+            [](const char *key, void *context) -> bool
+            {
+                Instance->claimSlot(key);
+                return false;
+            },
+            NULL));
+    }
+
+    bool Controller::growSlots()
+    {
+        // Slots keep their numbers when growing, only the buckets are rebuilt for the new capacity
+        uint32_t capacity = this->capacity > 0 ? this->capacity * 2 : MIN_SLOTS;
+        if (capacity > MAX_SLOTS)
+            capacity = MAX_SLOTS;
+        if (capacity == this->capacity)
+            return false;
+
+        const char **slots = (const char **)realloc((void *)this->slots, capacity * sizeof(char *));
+        if (slots == NULL)
+            return false;
+        this->slots = slots;
+
+        uint32_t *hashes = (uint32_t *)realloc((void *)this->hashes, capacity * sizeof(uint32_t));
+        if (hashes == NULL)
+            return false;
+        this->hashes = hashes;
+
+        uint16_t *chains = (uint16_t *)realloc((void *)this->chains, capacity * sizeof(uint16_t));
+        if (chains == NULL)
+            return false;
+        this->chains = chains;
+
+        uint16_t *buckets = (uint16_t *)realloc((void *)this->buckets, capacity * sizeof(uint16_t));
+        if (buckets == NULL)
+            return false;
+        this->buckets = buckets;
+
+        memset(&this->slots[this->capacity], 0, (capacity - this->capacity) * sizeof(char *));
+        this->capacity = capacity;
+
+        for (uint16_t bucket = 0; bucket < this->capacity; bucket++)
+            this->buckets[bucket] = NO_SLOT;
+        for (uint16_t slot = 0; slot < this->top; slot++)
+            if (this->slots[slot] != NULL)
+                this->indexSlot(slot);
+
+        return true;
+    }
+
+    void Controller::indexSlot(uint16_t slot)
+    {
+        uint16_t bucket = this->hashes[slot] % this->capacity;
+        this->chains[slot] = this->buckets[bucket];
+        this->buckets[bucket] = slot;
+    }
+
+    void Controller::unindexSlot(uint16_t slot)
+    {
+        uint16_t *link = &this->buckets[this->hashes[slot] % this->capacity];
+        while (*link != slot)
+            link = &this->chains[*link];
+
+        *link = this->chains[slot];
+    }
+
+    uint16_t Controller::findSlot(const char *name)
+    {
+        if (this->capacity == 0)
+            return NO_SLOT;
+
+        uint32_t hash = database::Pool::Hash(name);
+
+        for (uint16_t slot = this->buckets[hash % this->capacity]; slot != NO_SLOT; slot = this->chains[slot])
+            if (this->hashes[slot] == hash && !strcmp(this->slots[slot], name))
+                return slot;
+
+        return NO_SLOT;
+    }
+
+    uint16_t Controller::claimSlot(const char *name)
+    {
+        uint16_t slot = this->findSlot(name);
+        if (slot != NO_SLOT)
+            return slot;
+
+        // Take a never used slot, then a released one, and only then grow
+        if (this->top < this->capacity)
+            slot = this->top++;
+        else
+        {
+            for (slot = 0; slot < this->capacity && this->slots[slot] != NULL; slot++)
+                ;
+
+            if (slot == this->capacity)
+            {
+                if (!this->growSlots())
+                {
+                    // The device is still stored, it is just left out of non admin roles
+                    this->logger->Error(TAG, "No slot for device %s", name);
+                    return NO_SLOT;
+                }
+
+                slot = this->top++;
+            }
+        }
+
+        this->slots[slot] = strdup(name);
+        this->hashes[slot] = database::Pool::Hash(name);
+        this->indexSlot(slot);
+
+        return slot;
+    }
+
+    void Controller::releaseSlot(const char *name)
+    {
+        uint16_t slot = this->findSlot(name);
+        if (slot == NO_SLOT)
+            return;
+
+        this->unindexSlot(slot);
+
+        free((void *)this->slots[slot]);
+        this->slots[slot] = NULL;
+        this->hashes[slot] = 0;
+    }
+
+    void Controller::overlay(Device *device)
+    {
+        if (device == NULL)
+            return;
+
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+
+        device->Slot = this->findSlot(device->Name);
+
+        if (device->Kind != NULL && device->Kind->State != NULL)
+        {
+            State *state = this->findState(device->Name);
+            if (state != NULL)
+                *device->Kind->State(&device->Context) = state->Value;
+        }
+
+        xSemaphoreGive(this->lock);
+    }
+
     uint32_t Controller::Count()
     {
         uint32_t count;
@@ -231,6 +556,21 @@ namespace device
         return count;
     }
 
+    uint32_t Controller::Generation()
+    {
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+        uint32_t generation = this->generation;
+        xSemaphoreGive(this->lock);
+
+        // Both only grow, so their sum changes whenever either does
+        return this->db->Generation() + generation;
+    }
+
+    uint32_t Controller::DefinitionGeneration()
+    {
+        return this->db->Generation();
+    }
+
     Device *Controller::GetByName(const char *name)
     {
         Device *device = NULL;
@@ -243,6 +583,8 @@ namespace device
 
         cJSON_Delete(deviceJSON);
 
+        this->overlay(device);
+
         return device;
     }
 
@@ -259,21 +601,24 @@ namespace device
             .identifier = identifier,
         };
 
-        ESP_ERROR_CHECK(this->db->Find(
+        ESP_ERROR_CHECK(this->db->Lookup(
+            DB_INDEX_IDENTIFIERS, identifier,
             [](const char *key, void *funcArgs) -> bool
             {
                 cJSON *deviceJSON = NULL;
                 ESP_ERROR_CHECK(Instance->db->Get(key, &deviceJSON));
 
-                if (!strcmp(cJSON_GetObjectItem(deviceJSON, "type")->valuestring, Types::Sensor))
+                // Index matches can be stale, verify them against the record
+                if (deviceJSON != NULL && !strcmp(cJSON_GetObjectItem(deviceJSON, "type")->valuestring, Types::Sensor))
                 {
                     findArgs *args = (findArgs *)funcArgs;
-                    cJSON *context = cJSON_GetObjectItem(deviceJSON, "context");
+                    const DeviceKind *kind = DeviceKind::Find(cJSON_GetObjectItem(deviceJSON, "subtype")->valuestring);
 
-                    if (!strcmp(cJSON_GetObjectItem(deviceJSON, "subtype")->valuestring, Subtypes::Bistate))
+                    const char *terms[database::INDEX_MAX_TERMS];
+                    uint8_t count = kind != NULL && kind->Identifiers != NULL ? kind->Identifiers(cJSON_GetObjectItem(deviceJSON, "context"), terms) : 0;
+                    for (uint8_t i = 0; i < count; i++)
                     {
-                        if (!strcmp(cJSON_GetObjectItem(context, "identifier1")->valuestring, args->identifier) ||
-                            !strcmp(cJSON_GetObjectItem(context, "identifier2")->valuestring, args->identifier))
+                        if (!strcmp(terms[i], args->identifier))
                         {
                             args->device = new Device(deviceJSON);
                             cJSON_Delete(deviceJSON);
@@ -287,52 +632,258 @@ namespace device
             },
             &args));
 
+        this->overlay(args.device);
+
         return args.device;
     }
 
-    Device *Controller::List(uint32_t *size)
+    void Controller::List(database::ResultSet<Device> *devices)
     {
-        uint32_t count = this->Count();
-        *size = count;
-        if (count < 1)
-            return NULL;
+        // Size the result set for the current records, ones added meanwhile just grow it
+        devices->Reserve(this->Count());
 
-        Device *list = new Device[count];
-        Device *aux = list;
+        ESP_ERROR_CHECK(this->db->Scan(
+            [](const char *key, cJSON *deviceJSON, void *context) -> bool
+            {
+                ((database::ResultSet<Device> *)context)->Add(deviceJSON);
+                return false;
+            },
+            devices));
 
-        ESP_ERROR_CHECK(this->db->Find(
-            [](const char *key, void *context) -> bool
+        for (uint32_t i = 0; i < devices->Size(); i++)
+            this->overlay(&(*devices)[i]);
+    }
+
+    void Controller::List(database::ResultSet<Device> *devices, uint32_t limit, database::Cursor *cursor)
+    {
+        // Pages are bounded, so they are allocated upfront
+        devices->Reserve(limit);
+
+        ESP_ERROR_CHECK(this->db->Scan(
+            [](const char *key, cJSON *deviceJSON, void *context) -> bool
             {
-                Device *list = *(Device **)context;
+                ((database::ResultSet<Device> *)context)->Add(deviceJSON);
+                return false;
+            },
+            devices, limit, cursor));
 
-                cJSON *deviceJSON = NULL;
-                ESP_ERROR_CHECK(Instance->db->Get(key, &deviceJSON));
+        for (uint32_t i = 0; i < devices->Size(); i++)
+            this->overlay(&(*devices)[i]);
+    }
 
-                *list = Device(deviceJSON);
-                (*(Device **)context)++;
+    typedef struct listArgs
+    {
+        Controller *controller;
+        device_list_cb_t list;
+        void *context;
+        database::Arena *arena;
+    } listArgs;
+
+    void Controller::List(device_list_cb_t list, void *context)
+    {
+        // Devices are built one at a time, reusing the same arena
+        database::Arena arena;
+        listArgs args = {this, list, context, &arena};
+
+        ESP_ERROR_CHECK(this->db->Scan(
+            [](const char *key, cJSON *deviceJSON, void *context) -> bool
+            {
+                listArgs *args = (listArgs *)context;
+
+                Device *device = new (args->arena->Allocate(sizeof(Device))) Device(deviceJSON, args->arena);
+                args->controller->overlay(device);
+                args->list(device, args->context);
+                args->arena->Reset();
 
-                cJSON_Delete(deviceJSON);
                 return false;
             },
-            &aux));
+            &args));
+    }
+
+    void Controller::List(device_list_cb_t list, void *context, uint32_t limit, database::Cursor *cursor)
+    {
+        // Devices are built one at a time, reusing the same arena
+        database::Arena arena;
+        listArgs args = {this, list, context, &arena};
 
-        return list;
+        ESP_ERROR_CHECK(this->db->Scan(
+            [](const char *key, cJSON *deviceJSON, void *context) -> bool
+            {
+                listArgs *args = (listArgs *)context;
+
+                Device *device = new (args->arena->Allocate(sizeof(Device))) Device(deviceJSON, args->arena);
+                args->controller->overlay(device);
+                args->list(device, args->context);
+                args->arena->Reset();
+
+                return false;
+            },
+            &args, limit, cursor));
     }
 
     void Controller::Set(Device *device)
     {
         cJSON *deviceJSON = device->JSON();
-        ESP_ERROR_CHECK(this->db->Set(device->Name, deviceJSON));
+
+        // Definitions are stored without the state
+        cJSON_DeleteItemFromObject(cJSON_GetObjectItem(deviceJSON, "context"), "state");
+
+        xSemaphoreTake(this->writer, portMAX_DELAY);
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+
+        device->Slot = this->claimSlot(device->Name);
+
+        if (device->Kind == NULL || device->Kind->State == NULL)
+        {
+            xSemaphoreGive(this->lock);
+
+            ESP_ERROR_CHECK(this->db->Set(device->Name, deviceJSON));
+        }
+        else
+        {
+            // The live state always wins over the one of the device, which might have been read before the last update
+            State *state = this->findState(device->Name);
+            if (state == NULL)
+            {
+                state = new State();
+                strcpy(state->Name, device->Name);
+                state->Value = *device->Kind->State(&device->Context);
+                state->Next = this->states;
+                this->states = state;
+            }
+            state->Dirty = false;
+
+            StateRecord record = {
+                .State = state->Value,
+            };
+
+            // Flash is written without the lock, so state updates of other devices are not held behind it
+            xSemaphoreGive(this->lock);
+
+            database::WriteBatch batch;
+            batch.Set(this->db, device->Name, deviceJSON);
+            batch.SetBlob(this->stateDb, device->Name, &record, sizeof(StateRecord));
+            ESP_ERROR_CHECK(batch.Commit());
+        }
+
+        xSemaphoreGive(this->writer);
+
         cJSON_Delete(deviceJSON);
     }
 
     void Controller::Delete(const char *name)
     {
-        ESP_ERROR_CHECK(this->db->Delete(name));
+        database::WriteBatch batch;
+        this->Delete(name, &batch);
+        ESP_ERROR_CHECK(batch.Commit());
+    }
+
+    void Controller::Delete(const char *name, database::WriteBatch *batch)
+    {
+        // Waits for a flush that already took the state of the device, so it cannot land after the delete
+        xSemaphoreTake(this->writer, portMAX_DELAY);
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+        this->removeState(name);
+        this->releaseSlot(name);
+        batch->Delete(this->db, name);
+        batch->Delete(this->stateDb, name);
+        xSemaphoreGive(this->lock);
+        xSemaphoreGive(this->writer);
     }
 
     void Controller::Drop()
     {
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+        while (this->states != NULL)
+            this->removeState(this->states->Name);
+        for (uint16_t slot = 0; slot < this->top; slot++)
+        {
+            free((void *)this->slots[slot]);
+            this->slots[slot] = NULL;
+            this->hashes[slot] = 0;
+        }
+        for (uint16_t bucket = 0; bucket < this->capacity; bucket++)
+            this->buckets[bucket] = NO_SLOT;
+        this->top = 0;
         ESP_ERROR_CHECK(this->db->Drop());
+        ESP_ERROR_CHECK(this->stateDb->Drop());
+        xSemaphoreGive(this->lock);
+    }
+
+    void Controller::SetState(Device *sensor, uint8_t state)
+    {
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+
+        // Sensors are read with their live state, so repeated frames do not change it, and deleted sensors
+        // can still be held by the receiver, which must not bring their state back
+        if (*sensor->Kind->State(&sensor->Context) == state || this->findSlot(sensor->Name) == NO_SLOT)
+        {
+            xSemaphoreGive(this->lock);
+            return;
+        }
+
+        State *live = this->findState(sensor->Name);
+        if (live == NULL)
+        {
+            live = new State();
+            strcpy(live->Name, sensor->Name);
+            live->Next = this->states;
+            this->states = live;
+        }
+
+        live->Value = state;
+        live->Dirty = true;
+        this->generation++;
+
+        xSemaphoreGive(this->lock);
+
+        *sensor->Kind->State(&sensor->Context) = state;
+
+        xTaskNotifyGive(this->taskHandle);
+    }
+
+    uint16_t Controller::Slot(const char *name)
+    {
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+        uint16_t slot = this->findSlot(name);
+        xSemaphoreGive(this->lock);
+
+        return slot;
+    }
+
+    void Controller::SetFlushDelay(TickType_t delay)
+    {
+        this->flushDelay = delay;
+    }
+
+    void Controller::Flush()
+    {
+        xSemaphoreTake(this->writer, portMAX_DELAY);
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+
+        // Commit all pending states at once, definitions are left untouched
+        database::WriteBatch batch;
+
+        for (State *state = this->states; state != NULL; state = state->Next)
+        {
+            // Only states of devices that still exist are written
+            if (!state->Dirty || this->findSlot(state->Name) == NO_SLOT)
+                continue;
+
+            state->Dirty = false;
+
+            StateRecord record = {
+                .State = state->Value,
+            };
+
+            batch.SetBlob(this->stateDb, state->Name, &record, sizeof(StateRecord));
+        }
+
+        // Flash is written without the lock, so state updates are not held behind it
+        xSemaphoreGive(this->lock);
+
+        ESP_ERROR_CHECK(batch.Commit());
+
+        xSemaphoreGive(this->writer);
     }
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "esp_attr.h"
 #include "cJSON.h"
 #include "logger.hpp"
@@ -15,6 +16,40 @@ namespace device
     static const char *TAG = "device";
 
     static const char *DB_NAMESPACE = "device";
+    static const uint32_t DB_CACHE_SIZE = 8 * 1024; // Bytes
+    static const char *DB_INDEX_IDENTIFIERS = "device_ident"; // Bistate sensor identifier -> device name
+    static const char *DB_STATE_NAMESPACE = "device_state";   // Device name -> StateRecord
+
+    static const TickType_t STATE_FLUSH_DELAY = (5 * 1000) / portTICK_PERIOD_MS;      // 5 seconds without state updates
+    static const TickType_t STATE_FLUSH_MAX_DELAY = (60 * 1000) / portTICK_PERIOD_MS; // 1 minute of constant state updates
+
+    static const uint16_t MIN_SLOTS = 32;         // Initial, doubled whenever every slot is taken
+    static const uint16_t NO_SLOT = UINT16_MAX;   // Of devices that are not stored, or once slots cannot grow
+    static const uint16_t MAX_SLOTS = NO_SLOT;
+
+    // Union of all subtype contexts, only the ones of the device subtype are present
+    static const database::Field DB_CONTEXT_FIELDS[] = {
+        {"command", database::FIELD_STRING},
+        {"emoji", database::FIELD_STRING},
+        {"identifier1", database::FIELD_STRING},
+        {"emoji1", database::FIELD_STRING},
+        {"identifier2", database::FIELD_STRING},
+        {"emoji2", database::FIELD_STRING},
+        {"state", database::FIELD_NUMBER}, // Legacy, moved to the state namespace
+    };
+    static const database::Schema DB_CONTEXT_SCHEMA = {1, DB_CONTEXT_FIELDS, sizeof(DB_CONTEXT_FIELDS) / sizeof(database::Field)};
+
+    static const database::Field DB_FIELDS[] = {
+        {"name", database::FIELD_STRING},
+        {"type", database::FIELD_STRING},
+        {"subtype", database::FIELD_STRING},
+        {"protocol", database::FIELD_NUMBER},
+        {"context", database::FIELD_OBJECT, &DB_CONTEXT_SCHEMA},
+        {"emoji", database::FIELD_STRING},
+        {"creator", database::FIELD_STRING},
+        {"created_at", database::FIELD_NUMBER},
+    };
+    static const database::Schema DB_SCHEMA = {1, DB_FIELDS, sizeof(DB_FIELDS) / sizeof(database::Field)};
 
     static const int MAX_SYNC_PULSES = 4;      // Max PROTOCOLS(Sync) * 2 (extra end sync)
     static const int MAX_PREAMBLE_PULSES = 24; // Max PROTOCOLS(Preamble)
@@ -79,16 +114,17 @@ namespace device
         char Data[MAX_DATA_PULSES / MAX_DATA_BIT_PULSES + 1]; // '\0' terminated c-string
     };
 
+    // Registered in the string pool, so interned types and subtypes can be compared by pointer with them
     namespace Types
     {
-        static const char *Sensor = "SENSOR";
-        static const char *Actuator = "ACTUATOR";
+        inline constexpr const char *Sensor = "SENSOR";
+        inline constexpr const char *Actuator = "ACTUATOR";
     }
 
     namespace Subtypes
     {
-        static const char *Button = "BUTTON";
-        static const char *Bistate = "BISTATE";
+        inline constexpr const char *Button = "BUTTON";
+        inline constexpr const char *Bistate = "BISTATE";
     }
 
     namespace Contexts
@@ -115,16 +151,71 @@ namespace device
         Contexts::Bistate Bistate;
     } Context;
 
+    // Runtime state of a device, stored apart from its definition so updates only rewrite a few bytes
+    typedef struct StateRecord
+    {
+        uint8_t State;
+    } StateRecord;
+
+    // Set of devices by slot, so membership is a bit test. Words grow with the highest slot added.
+    class Slots
+    {
+    public:
+        uint32_t *Words;
+        uint16_t Size; // Words
+
+    public:
+        Slots();
+        ~Slots();
+        Slots(const Slots &other);
+        Slots &operator=(const Slots &other);
+        void Add(uint16_t slot);
+        void Remove(uint16_t slot);
+        bool Has(uint16_t slot) const; // False for NO_SLOT
+    };
+
+    typedef enum KindID
+    {
+        KIND_BUTTON,
+        KIND_BISTATE,
+        KIND_MAX,
+    } KindID;
+
+    // Behaviour of a device subtype. Devices point to their kind and dispatch through it
+    // instead of comparing subtypes, so a new subtype only takes a new entry in KINDS.
+    class DeviceKind
+    {
+    public:
+        KindID ID;
+        const char *Subtype;
+        void (*Bind)(cJSON *src, union Context *dst);                           // Points the definition into src, leaving the state
+        void (*Decode)(cJSON *src, union Context *dst, database::Arena *arena); // Copies the strings of src, to the arena when given
+        void (*Copy)(const union Context *src, union Context *dst);
+        void (*Free)(union Context *context);
+        void (*Encode)(const union Context *src, cJSON *dst);
+        uint8_t (*Identifiers)(cJSON *src, const char *terms[database::INDEX_MAX_TERMS]); // Of the frames a sensor receives, NULL if none
+        uint8_t *(*State)(union Context *context);                                         // NULL for stateless kinds
+        uint8_t (*Sense)(const union Context *context, const char *data);                  // State of a sensor after receiving data
+        void (*Command)(const union Context *context, Packet *packet);                     // Data an actuator is triggered with
+
+    public:
+        static const DeviceKind *Find(const char *subtype);
+    };
+
+    extern const DeviceKind KINDS[KIND_MAX];
+
     class Device
     {
     public:
         const char *Name;
-        const char *Type;
-        const char *Subtype;
+        const char *Type;    // Interned
+        const char *Subtype; // Interned
+        const DeviceKind *Kind; // Of the subtype, NULL if unknown
+        uint16_t Slot;          // Assigned in memory by the controller, not stored
         uint8_t Protocol;
         union Context Context;
         const char *Emoji;
-        const char *Creator;
+        const char *Creator; // Interned
         time_t CreatedAt;
 
     public:
@@ -132,20 +223,62 @@ namespace device
         Device(const char *name, const char *type, const char *subtype,
                uint8_t protocol, union Context context, const char *emoji,
                const char *creator, time_t createdAt);
-        Device(cJSON *src);
+        Device(cJSON *src, database::Arena *arena = NULL); // Strings are copied from src, to the arena when given
+        Device(Device &&other);
         ~Device();
         Device &operator=(const Device &other);
+        Device &operator=(Device &&other);
         cJSON *JSON();
         bool Equals(const char *name) const;
         bool Equals(Device *other) const;
         bool Equals(const Device *other) const;
     };
 
+    // Receives each listed device, which is only valid during the call
+    typedef void (*device_list_cb_t)(Device *device, void *context);
+
     class Controller
     {
     private:
+        // Live sensor state, flushed to the database once updates settle
+        class State
+        {
+        public:
+            char Name[NVS_KEY_NAME_MAX_SIZE];
+            uint8_t Value;
+            bool Dirty;
+            State *Next;
+        };
+
         logger::Logger *logger;
         database::Handle *db;
+        database::Handle *stateDb;
+        TaskHandle_t taskHandle;
+        SemaphoreHandle_t lock;
+        SemaphoreHandle_t writer; // Keeps state snapshots reaching the flash in the order they were taken, deletes included
+        State *states;
+        uint32_t generation; // Of the live states
+        TickType_t flushDelay;
+        const char **slots; // Device names by slot, NULL if free
+        uint32_t *hashes;   // Of the slot names
+        uint16_t *buckets;  // First slot by name hash, as many as slots
+        uint16_t *chains;   // Next slot with the same bucket, by slot
+        uint16_t capacity;  // Slots
+        uint16_t top;       // Slots ever taken, the ones above are free
+
+    private:
+        static void taskFunc(void *args);
+        void loadStates();
+        State *findState(const char *name);
+        void removeState(const char *name);
+        void loadSlots();
+        bool growSlots();
+        void indexSlot(uint16_t slot);
+        void unindexSlot(uint16_t slot);
+        uint16_t findSlot(const char *name);
+        uint16_t claimSlot(const char *name);
+        void releaseSlot(const char *name);
+        void overlay(Device *device);
 
     public:
         inline static Controller *Instance;
@@ -153,12 +286,22 @@ namespace device
 
     public:
         uint32_t Count();
+        uint32_t Generation();           // Bumped whenever the definitions or the live states change
+        uint32_t DefinitionGeneration(); // Bumped whenever the definitions change
         Device *GetByName(const char *name);
         Device *GetSensorByIdentifier(const char *identifier);
-        Device *List(uint32_t *size);
+        void List(database::ResultSet<Device> *devices);
+        void List(database::ResultSet<Device> *devices, uint32_t limit, database::Cursor *cursor);
+        void List(device_list_cb_t list, void *context);
+        void List(device_list_cb_t list, void *context, uint32_t limit, database::Cursor *cursor);
         void Set(Device *device);
         void Delete(const char *name);
+        void Delete(const char *name, database::WriteBatch *batch);
         void Drop();
+        void SetState(Device *sensor, uint8_t state);
+        uint16_t Slot(const char *name); // NO_SLOT if the device does not exist
+        void SetFlushDelay(TickType_t delay);
+        void Flush();
     };
 
     class Receiver
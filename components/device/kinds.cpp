@@ -0,0 +1,131 @@
+#include <string.h>
+#include <stdlib.h>
+#include "cJSON.h"
+#include "database.hpp"
+#include "device.hpp"
+
+namespace device
+{
+    static void bindButton(cJSON *src, union Context *dst)
+    {
+        dst->Button.Command = cJSON_GetObjectItem(src, "command")->valuestring;
+        dst->Button.Emoji = cJSON_GetObjectItem(src, "emoji")->valuestring;
+    }
+
+    static void decodeButton(cJSON *src, union Context *dst, database::Arena *arena)
+    {
+        dst->Button.Command = database::Arena::Copy(arena, cJSON_GetObjectItem(src, "command"));
+        dst->Button.Emoji = database::Arena::Copy(arena, cJSON_GetObjectItem(src, "emoji"));
+    }
+
+    static void copyButton(const union Context *src, union Context *dst)
+    {
+        dst->Button.Command = strdup(src->Button.Command);
+        dst->Button.Emoji = strdup(src->Button.Emoji);
+    }
+
+    static void freeButton(union Context *context)
+    {
+        free((void *)context->Button.Command);
+        free((void *)context->Button.Emoji);
+    }
+
+    static void encodeButton(const union Context *src, cJSON *dst)
+    {
+        cJSON_AddStringToObject(dst, "command", src->Button.Command);
+        cJSON_AddStringToObject(dst, "emoji", src->Button.Emoji);
+    }
+
+    static void commandButton(const union Context *context, Packet *packet)
+    {
+        strcpy(packet->Data, context->Button.Command);
+    }
+
+    static void bindBistate(cJSON *src, union Context *dst)
+    {
+        dst->Bistate.Identifier1 = cJSON_GetObjectItem(src, "identifier1")->valuestring;
+        dst->Bistate.Emoji1 = cJSON_GetObjectItem(src, "emoji1")->valuestring;
+        dst->Bistate.Identifier2 = cJSON_GetObjectItem(src, "identifier2")->valuestring;
+        dst->Bistate.Emoji2 = cJSON_GetObjectItem(src, "emoji2")->valuestring;
+    }
+
+    static void decodeBistate(cJSON *src, union Context *dst, database::Arena *arena)
+    {
+        dst->Bistate.Identifier1 = database::Arena::Copy(arena, cJSON_GetObjectItem(src, "identifier1"));
+        dst->Bistate.Emoji1 = database::Arena::Copy(arena, cJSON_GetObjectItem(src, "emoji1"));
+        dst->Bistate.Identifier2 = database::Arena::Copy(arena, cJSON_GetObjectItem(src, "identifier2"));
+        dst->Bistate.Emoji2 = database::Arena::Copy(arena, cJSON_GetObjectItem(src, "emoji2"));
+
+        // Stored definitions no longer hold the state, which is overlaid by the controller
+        cJSON *state = cJSON_GetObjectItem(src, "state");
+        dst->Bistate.State = state != NULL ? state->valueint : 0;
+    }
+
+    static void copyBistate(const union Context *src, union Context *dst)
+    {
+        dst->Bistate.Identifier1 = strdup(src->Bistate.Identifier1);
+        dst->Bistate.Emoji1 = strdup(src->Bistate.Emoji1);
+        dst->Bistate.Identifier2 = strdup(src->Bistate.Identifier2);
+        dst->Bistate.Emoji2 = strdup(src->Bistate.Emoji2);
+        dst->Bistate.State = src->Bistate.State;
+    }
+
+    static void freeBistate(union Context *context)
+    {
+        free((void *)context->Bistate.Identifier1);
+        free((void *)context->Bistate.Emoji1);
+        free((void *)context->Bistate.Identifier2);
+        free((void *)context->Bistate.Emoji2);
+    }
+
+    static void encodeBistate(const union Context *src, cJSON *dst)
+    {
+        cJSON_AddStringToObject(dst, "identifier1", src->Bistate.Identifier1);
+        cJSON_AddStringToObject(dst, "emoji1", src->Bistate.Emoji1);
+        cJSON_AddStringToObject(dst, "identifier2", src->Bistate.Identifier2);
+        cJSON_AddStringToObject(dst, "emoji2", src->Bistate.Emoji2);
+        cJSON_AddNumberToObject(dst, "state", src->Bistate.State);
+    }
+
+    static uint8_t identifiersBistate(cJSON *src, const char *terms[database::INDEX_MAX_TERMS])
+    {
+        terms[0] = cJSON_GetObjectItem(src, "identifier1")->valuestring;
+        terms[1] = cJSON_GetObjectItem(src, "identifier2")->valuestring;
+
+        return 2;
+    }
+
+    static uint8_t *stateBistate(union Context *context)
+    {
+        return &context->Bistate.State;
+    }
+
+    static uint8_t senseBistate(const union Context *context, const char *data)
+    {
+        if (!strcmp(data, context->Bistate.Identifier1))
+            return 1;
+        else if (!strcmp(data, context->Bistate.Identifier2))
+            return 2;
+
+        return 0;
+    }
+
+    constexpr DeviceKind KINDS[KIND_MAX] = {
+        {KIND_BUTTON, Subtypes::Button, bindButton, decodeButton, copyButton, freeButton, encodeButton, NULL, NULL, NULL, commandButton},
+        {KIND_BISTATE, Subtypes::Bistate, bindBistate, decodeBistate, copyBistate, freeBistate, encodeBistate, identifiersBistate, stateBistate, senseBistate, NULL},
+    };
+
+    const DeviceKind *DeviceKind::Find(const char *subtype)
+    {
+        // Interned subtypes match by pointer, others such as request ones by value
+        for (int i = 0; i < KIND_MAX; i++)
+            if (KINDS[i].Subtype == subtype)
+                return &KINDS[i];
+
+        for (int i = 0; i < KIND_MAX; i++)
+            if (!strcmp(KINDS[i].Subtype, subtype))
+                return &KINDS[i];
+
+        return NULL;
+    }
+}
\ No newline at end of file
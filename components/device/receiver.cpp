@@ -226,19 +226,9 @@ namespace device
             {
                 Instance->logger->Debug(TAG, "Received data from %s", sensor->Name);
 
-                // Update context depending on sensor subtype
-                if (!strcmp(sensor->Subtype, Subtypes::Bistate))
-                {
-                    if (!strcmp(packet->Data, sensor->Context.Bistate.Identifier1))
-                        sensor->Context.Bistate.State = 1;
-                    else if (!strcmp(packet->Data, sensor->Context.Bistate.Identifier2))
-                        sensor->Context.Bistate.State = 2;
-                    else
-                        sensor->Context.Bistate.State = 0;
-                }
-
-                // Save updated sensor context
-                Instance->device->Set(sensor);
+                // Update state depending on sensor kind, repeated frames are coalesced by the controller
+                if (sensor->Kind != NULL && sensor->Kind->Sense != NULL)
+                    Instance->device->SetState(sensor, sensor->Kind->Sense(&sensor->Context, packet->Data));
             }
 
             delete sensor;
@@ -38,13 +38,29 @@ namespace provisioner
 
     Credentials::Credentials(cJSON *src)
     {
-        this->SSID = strdup(cJSON_GetObjectItem(src, "ssid")->valuestring);
-        this->Password = strdup(cJSON_GetObjectItem(src, "password")->valuestring);
+        this->SSID = database::Arena::Copy(NULL, cJSON_GetObjectItem(src, "ssid"));
+        this->Password = database::Arena::Copy(NULL, cJSON_GetObjectItem(src, "password"));
 
         cJSON *ip = cJSON_GetObjectItem(src, "ip");
-        this->IP.Address = strdup(cJSON_GetObjectItem(ip, "address")->valuestring);
-        this->IP.Netmask = strdup(cJSON_GetObjectItem(ip, "netmask")->valuestring);
-        this->IP.Gateway = strdup(cJSON_GetObjectItem(ip, "gateway")->valuestring);
+        this->IP.Address = database::Arena::Copy(NULL, cJSON_GetObjectItem(ip, "address"));
+        this->IP.Netmask = database::Arena::Copy(NULL, cJSON_GetObjectItem(ip, "netmask"));
+        this->IP.Gateway = database::Arena::Copy(NULL, cJSON_GetObjectItem(ip, "gateway"));
+    }
+
+    Credentials::Credentials(Credentials &&other)
+    {
+        // Take over the strings of other, which is left empty
+        this->SSID = other.SSID;
+        this->Password = other.Password;
+        this->IP.Address = other.IP.Address;
+        this->IP.Netmask = other.IP.Netmask;
+        this->IP.Gateway = other.IP.Gateway;
+
+        other.SSID = NULL;
+        other.Password = NULL;
+        other.IP.Address = NULL;
+        other.IP.Netmask = NULL;
+        other.IP.Gateway = NULL;
     }
 
     Credentials::~Credentials()
@@ -76,6 +92,32 @@ namespace provisioner
         return *this;
     }
 
+    Credentials &Credentials::operator=(Credentials &&other)
+    {
+        if (this == &other)
+            return *this;
+
+        free((void *)this->SSID);
+        free((void *)this->Password);
+        free((void *)this->IP.Address);
+        free((void *)this->IP.Netmask);
+        free((void *)this->IP.Gateway);
+
+        this->SSID = other.SSID;
+        this->Password = other.Password;
+        this->IP.Address = other.IP.Address;
+        this->IP.Netmask = other.IP.Netmask;
+        this->IP.Gateway = other.IP.Gateway;
+
+        other.SSID = NULL;
+        other.Password = NULL;
+        other.IP.Address = NULL;
+        other.IP.Netmask = NULL;
+        other.IP.Gateway = NULL;
+
+        return *this;
+    }
+
     cJSON *Credentials::JSON()
     {
         cJSON *root = cJSON_CreateObject();
@@ -102,6 +144,7 @@ namespace provisioner
         Instance->logger = logger;
         Instance->status = status;
         Instance->db = database->Open(DB_NAMESPACE);
+        Instance->db->SetSchema(&DB_SCHEMA);
 
         // Set provisioning status
         Instance->status->SetStatus(status::Statuses::Provisioning);
@@ -369,7 +412,7 @@ namespace provisioner
             {
                 Instance->logger->Debug(TAG, "Fallbacking into softAP mode: SSID=%s | Password=%s", AP_SSID, AP_PASSWORD);
                 Instance->staStop();
-                Credentials creds = Credentials(AP_SSID, AP_PASSWORD, {AP_STATIC_IP_ADDRESS, AP_STATIC_IP_NETMASK, AP_STATIC_IP_GATEWAY});
+                Credentials creds(AP_SSID, AP_PASSWORD, {AP_STATIC_IP_ADDRESS, AP_STATIC_IP_NETMASK, AP_STATIC_IP_GATEWAY});
                 Instance->apStart(&creds);
             }
             // Ignore further Wi-Fi station disconnections. This can happen because when station
@@ -14,6 +14,20 @@ namespace provisioner
     static const char *TAG = "provisioner";
 
     static const char *DB_NAMESPACE = "system";
+
+    static const database::Field DB_IP_FIELDS[] = {
+        {"address", database::FIELD_STRING},
+        {"netmask", database::FIELD_STRING},
+        {"gateway", database::FIELD_STRING},
+    };
+    static const database::Schema DB_IP_SCHEMA = {1, DB_IP_FIELDS, sizeof(DB_IP_FIELDS) / sizeof(database::Field)};
+
+    static const database::Field DB_FIELDS[] = {
+        {"ssid", database::FIELD_STRING},
+        {"password", database::FIELD_STRING},
+        {"ip", database::FIELD_OBJECT, &DB_IP_SCHEMA},
+    };
+    static const database::Schema DB_SCHEMA = {1, DB_FIELDS, sizeof(DB_FIELDS) / sizeof(database::Field)};
     static const TickType_t STARTUP_DELAY = (5 * 1000) / portTICK_PERIOD_MS; // 5 seconds
     static const uint16_t SCAN_MAX_NETWORKS = 25;
 
@@ -47,9 +61,11 @@ namespace provisioner
     public:
         Credentials();
         Credentials(const char *ssid, const char *password, struct IP ip);
-        Credentials(cJSON *src);
+        Credentials(cJSON *src); // Strings are copied from src
+        Credentials(Credentials &&other);
         ~Credentials();
         Credentials &operator=(const Credentials &other);
+        Credentials &operator=(Credentials &&other);
         cJSON *JSON();
     };
 
@@ -1,5 +1,7 @@
 #include <string.h>
 #include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "cJSON.h"
 #include "logger.hpp"
 #include "device.hpp"
@@ -31,36 +33,50 @@ namespace role
         this->Devices[size] = NULL;
 
         this->Emoji = strdup(emoji);
-        this->Creator = strdup(creator);
+        this->Creator = database::Pool::Intern(creator);
         this->CreatedAt = createdAt;
     }
 
-    Role::Role(cJSON *src)
+    Role::Role(cJSON *src, database::Arena *arena)
     {
-        this->Name = strdup(cJSON_GetObjectItem(src, "name")->valuestring);
+        this->Name = database::Arena::Copy(arena, cJSON_GetObjectItem(src, "name"));
 
         cJSON *devices = cJSON_GetObjectItem(src, "devices");
         int size = cJSON_GetArraySize(devices);
-        this->Devices = (const char **)malloc((size + 1) * sizeof(char *));
+        this->Devices = (const char **)(arena != NULL ? arena->Allocate((size + 1) * sizeof(char *)) : malloc((size + 1) * sizeof(char *)));
         for (int i = 0; i < size; i++)
-            this->Devices[i] = strdup(cJSON_GetArrayItem(devices, i)->valuestring);
+            this->Devices[i] = database::Arena::Copy(arena, cJSON_GetArrayItem(devices, i));
         this->Devices[size] = NULL;
 
-        this->Emoji = strdup(cJSON_GetObjectItem(src, "emoji")->valuestring);
-        this->Creator = strdup(cJSON_GetObjectItem(src, "creator")->valuestring);
+        this->Emoji = database::Arena::Copy(arena, cJSON_GetObjectItem(src, "emoji"));
+        this->Creator = database::Pool::Intern(cJSON_GetObjectItem(src, "creator")->valuestring);
         this->CreatedAt = cJSON_GetObjectItem(src, "created_at")->valueint;
     }
 
+    Role::Role(Role &&other)
+    {
+        // Take over the strings of other, which is left empty
+        this->Name = other.Name;
+        this->Devices = other.Devices;
+        this->Emoji = other.Emoji;
+        this->Creator = other.Creator;
+        this->CreatedAt = other.CreatedAt;
+
+        other.Name = NULL;
+        other.Devices = NULL;
+        other.Emoji = NULL;
+    }
+
     Role::~Role()
     {
         free((void *)this->Name);
 
-        for (int i = 0; this->Devices[i] != NULL; i++)
+        // Moved-from roles have no devices
+        for (int i = 0; this->Devices != NULL && this->Devices[i] != NULL; i++)
             free((void *)this->Devices[i]);
         free((void *)this->Devices);
 
         free((void *)this->Emoji);
-        free((void *)this->Creator);
     }
 
     Role &Role::operator=(const Role &other)
@@ -70,12 +86,11 @@ namespace role
 
         free((void *)this->Name);
 
-        for (int i = 0; this->Devices[i] != NULL; i++)
+        for (int i = 0; this->Devices != NULL && this->Devices[i] != NULL; i++)
             free((void *)this->Devices[i]);
         free((void *)this->Devices);
 
         free((void *)this->Emoji);
-        free((void *)this->Creator);
 
         this->Name = strdup(other.Name);
 
@@ -88,9 +103,35 @@ namespace role
         this->Devices[size] = NULL;
 
         this->Emoji = strdup(other.Emoji);
-        this->Creator = strdup(other.Creator);
+        this->Creator = other.Creator;
+        this->CreatedAt = other.CreatedAt;
+
+        return *this;
+    }
+
+    Role &Role::operator=(Role &&other)
+    {
+        if (this == &other)
+            return *this;
+
+        free((void *)this->Name);
+
+        for (int i = 0; this->Devices != NULL && this->Devices[i] != NULL; i++)
+            free((void *)this->Devices[i]);
+        free((void *)this->Devices);
+
+        free((void *)this->Emoji);
+
+        this->Name = other.Name;
+        this->Devices = other.Devices;
+        this->Emoji = other.Emoji;
+        this->Creator = other.Creator;
         this->CreatedAt = other.CreatedAt;
 
+        other.Name = NULL;
+        other.Devices = NULL;
+        other.Emoji = NULL;
+
         return *this;
     }
 
@@ -129,7 +170,7 @@ namespace role
         return this->Equals(other->Name);
     }
 
-    Controller *Controller::New(logger::Logger *logger, database::Database *database)
+    Controller *Controller::New(logger::Logger *logger, database::Database *database, device::Controller *device)
     {
         if (Instance != NULL)
             return Instance;
@@ -138,7 +179,24 @@ namespace role
 
         // Inject dependencies
         Instance->logger = logger;
+        Instance->device = device;
         Instance->db = database->Open(DB_NAMESPACE);
+        Instance->db->SetSchema(&DB_SCHEMA);
+        Instance->db->SetCache(DB_CACHE_SIZE);
+
+        Instance->entries = NULL;
+        Instance->lock = xSemaphoreCreateMutex();
+        if (!Instance->lock)
+            ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+
+        // Load the devices of every role
+        ESP_ERROR_CHECK(Instance->db->Scan(
+            [](const char *key, cJSON *roleJSON, void *context) -> bool
+            {
+                Instance->loadEntry(roleJSON);
+                return false;
+            },
+            NULL));
 
         // Create or reset default system roles
         Instance->Set((Role *)(&System::Admin));
@@ -147,6 +205,64 @@ namespace role
         return Instance;
     }
 
+    Controller::Entry *Controller::findEntry(const char *name)
+    {
+        // Interned names match by pointer, others such as request ones by value
+        for (Entry *entry = this->entries; entry != NULL; entry = entry->Next)
+            if (entry->Name == name)
+                return entry;
+
+        for (Entry *entry = this->entries; entry != NULL; entry = entry->Next)
+            if (!strcmp(entry->Name, name))
+                return entry;
+
+        return NULL;
+    }
+
+    void Controller::loadEntry(cJSON *roleJSON)
+    {
+        const char *name = database::Pool::Intern(cJSON_GetObjectItem(roleJSON, "name")->valuestring);
+
+        Entry *entry = this->findEntry(name);
+        if (entry == NULL)
+        {
+            entry = new Entry();
+            entry->Name = name;
+            entry->Next = this->entries;
+            this->entries = entry;
+        }
+
+        entry->Devices = device::Slots();
+
+        cJSON *devices = cJSON_GetObjectItem(roleJSON, "devices");
+        for (int i = 0; i < cJSON_GetArraySize(devices); i++)
+            entry->Devices.Add(this->device->Slot(cJSON_GetArrayItem(devices, i)->valuestring));
+    }
+
+    void Controller::removeEntry(const char *name)
+    {
+        Entry **link = &this->entries;
+        while (*link != NULL && strcmp((*link)->Name, name))
+            link = &(*link)->Next;
+
+        if (*link == NULL)
+            return;
+
+        Entry *entry = *link;
+        *link = entry->Next;
+        delete entry;
+    }
+
+    bool Controller::includes(const char *role, uint16_t slot)
+    {
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+        Entry *entry = this->findEntry(role);
+        bool ret = entry != NULL && entry->Devices.Has(slot);
+        xSemaphoreGive(this->lock);
+
+        return ret;
+    }
+
     uint32_t Controller::Count()
     {
         uint32_t count;
@@ -156,6 +272,11 @@ namespace role
         return count;
     }
 
+    uint32_t Controller::Generation()
+    {
+        return this->db->Generation();
+    }
+
     Role *Controller::Get(const char *name)
     {
         Role *role = NULL;
@@ -171,105 +292,100 @@ namespace role
         return role;
     }
 
-    Role *Controller::List(uint32_t *size)
+    void Controller::List(database::ResultSet<Role> *roles)
     {
-        uint32_t count = this->Count();
-        *size = count;
-        if (count < 1)
-            return NULL;
-
-        Role *list = new Role[count];
-        Role *aux = list;
+        // Size the result set for the current records, ones added meanwhile just grow it
+        roles->Reserve(this->Count());
 
-        ESP_ERROR_CHECK(this->db->Find(
-            [](const char *key, void *context) -> bool
+        ESP_ERROR_CHECK(this->db->Scan(
+            [](const char *key, cJSON *roleJSON, void *context) -> bool
             {
-                Role *list = *(Role **)context;
-
-                cJSON *roleJSON = NULL;
-                ESP_ERROR_CHECK(Instance->db->Get(key, &roleJSON));
+                ((database::ResultSet<Role> *)context)->Add(roleJSON);
+                return false;
+            },
+            roles));
+    }
 
-                *list = Role(roleJSON);
-                (*(Role **)context)++;
+    void Controller::List(database::ResultSet<Role> *roles, uint32_t limit, database::Cursor *cursor)
+    {
+        // Pages are bounded, so they are allocated upfront
+        roles->Reserve(limit);
 
-                cJSON_Delete(roleJSON);
+        ESP_ERROR_CHECK(this->db->Scan(
+            [](const char *key, cJSON *roleJSON, void *context) -> bool
+            {
+                ((database::ResultSet<Role> *)context)->Add(roleJSON);
                 return false;
             },
-            &aux));
-
-        return list;
+            roles, limit, cursor));
     }
 
     void Controller::Set(Role *role)
     {
         cJSON *roleJSON = role->JSON();
         ESP_ERROR_CHECK(this->db->Set(role->Name, roleJSON));
+
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+        this->loadEntry(roleJSON);
+        xSemaphoreGive(this->lock);
+
         cJSON_Delete(roleJSON);
     }
 
     void Controller::Delete(const char *name)
     {
         ESP_ERROR_CHECK(this->db->Delete(name));
+
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+        this->removeEntry(name);
+        xSemaphoreGive(this->lock);
     }
 
-    void Controller::RemoveDeviceFromAllRoles(const char *device)
+    void Controller::RemoveDeviceFromAllRoles(const char *device, database::WriteBatch *batch)
     {
-        // Get all roles, notice that updating an NVS entry while iterating is not possible
-        uint32_t size;
-        Role *roles = this->List(&size);
+        uint16_t slot = this->device->Slot(device);
 
-        // Remove device from role if included
-        for (int i = 0; i < size; i++)
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+
+        // Only the roles including the device are read
+        for (Entry *entry = this->entries; entry != NULL; entry = entry->Next)
         {
-            if (this->Includes(&roles[i], device))
+            if (!entry->Devices.Has(slot))
+                continue;
+
+            cJSON *roleJSON = NULL;
+            ESP_ERROR_CHECK(this->db->Get(entry->Name, &roleJSON));
+
+            if (roleJSON != NULL)
             {
-                int devicesSize = 0;
-                while (roles[i].Devices[devicesSize] != NULL)
-                    devicesSize++;
-
-                int newDevicesSize = devicesSize - 1;
-
-                const char **devices = (const char **)malloc((newDevicesSize + 1) * sizeof(char *));
-
-                devicesSize = 0;
-                newDevicesSize = 0;
-                while (roles[i].Devices[devicesSize] != NULL)
-                {
-                    if (strcmp(roles[i].Devices[devicesSize], device))
-                    {
-                        devices[newDevicesSize] = strdup(roles[i].Devices[devicesSize]);
-                        newDevicesSize++;
-                    }
-                    devicesSize++;
-                }
-                devices[newDevicesSize] = NULL;
-
-                for (int j = 0; roles[i].Devices[j] != NULL; j++)
-                    free((void *)roles[i].Devices[j]);
-                free((void *)roles[i].Devices);
-
-                // Passing freeing ownership
-                roles[i].Devices = devices;
-
-                this->Set(&roles[i]);
+                cJSON *devicesJSON = cJSON_GetObjectItem(roleJSON, "devices");
+                for (int j = cJSON_GetArraySize(devicesJSON) - 1; j >= 0; j--)
+                    if (!strcmp(cJSON_GetArrayItem(devicesJSON, j)->valuestring, device))
+                        cJSON_DeleteItemFromArray(devicesJSON, j);
+
+                // Committed along with the rest of the batch
+                batch->Set(this->db, entry->Name, roleJSON);
+                cJSON_Delete(roleJSON);
             }
+
+            entry->Devices.Remove(slot);
         }
 
-        delete[] roles;
+        xSemaphoreGive(this->lock);
     }
 
     void Controller::Drop()
     {
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+        while (this->entries != NULL)
+            this->removeEntry(this->entries->Name);
         ESP_ERROR_CHECK(this->db->Drop());
+        xSemaphoreGive(this->lock);
     }
 
     bool Controller::Includes(const char *role, const char *device)
     {
-        Role *roleAux = this->Get(role);
-        bool ret = this->Includes(roleAux, device);
-        delete roleAux;
-
-        return ret;
+        return this->includes(role, this->device->Slot(device));
     }
 
     bool Controller::Includes(Role *role, const char *device)
@@ -283,11 +399,19 @@ namespace role
 
     bool Controller::Includes(const char *role, device::Device *device)
     {
-        return this->Includes(role, device->Name);
+        return this->includes(role, device->Slot);
     }
 
     bool Controller::Includes(Role *role, device::Device *device)
     {
         return this->Includes(role, device->Name);
     }
+
+    void Controller::Devices(const char *role, device::Slots *devices)
+    {
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+        Entry *entry = this->findEntry(role);
+        *devices = entry != NULL ? entry->Devices : device::Slots();
+        xSemaphoreGive(this->lock);
+    }
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "cJSON.h"
 #include "logger.hpp"
 #include "device.hpp"
@@ -10,6 +12,16 @@ namespace role
     static const char *TAG = "role";
 
     static const char *DB_NAMESPACE = "role";
+    static const uint32_t DB_CACHE_SIZE = 2 * 1024; // Bytes
+
+    static const database::Field DB_FIELDS[] = {
+        {"name", database::FIELD_STRING},
+        {"devices", database::FIELD_STRINGS},
+        {"emoji", database::FIELD_STRING},
+        {"creator", database::FIELD_STRING},
+        {"created_at", database::FIELD_NUMBER},
+    };
+    static const database::Schema DB_SCHEMA = {1, DB_FIELDS, sizeof(DB_FIELDS) / sizeof(database::Field)};
 
     class Role
     {
@@ -17,16 +29,18 @@ namespace role
         const char *Name;
         const char **Devices; // NULL-terminated array of c-strings
         const char *Emoji;
-        const char *Creator;
+        const char *Creator; // Interned
         time_t CreatedAt;
 
     public:
         Role();
         Role(const char *name, const char **devices, const char *emoji,
              const char *creator, time_t createdAt);
-        Role(cJSON *src);
+        Role(cJSON *src, database::Arena *arena = NULL); // Strings are copied from src, to the arena when given
+        Role(Role &&other);
         ~Role();
         Role &operator=(const Role &other);
+        Role &operator=(Role &&other);
         cJSON *JSON();
         bool Equals(const char *name) const;
         bool Equals(Role *other) const;
@@ -42,24 +56,45 @@ namespace role
     class Controller
     {
     private:
+        // Devices of a role as a set of device slots, so membership checks do not read the role
+        class Entry
+        {
+        public:
+            const char *Name; // Interned
+            device::Slots Devices;
+            Entry *Next;
+        };
+
         logger::Logger *logger;
+        device::Controller *device;
         database::Handle *db;
+        SemaphoreHandle_t lock;
+        Entry *entries;
+
+    private:
+        Entry *findEntry(const char *name);
+        void loadEntry(cJSON *roleJSON);
+        void removeEntry(const char *name);
+        bool includes(const char *role, uint16_t slot);
 
     public:
         inline static Controller *Instance;
-        static Controller *New(logger::Logger *logger, database::Database *database);
+        static Controller *New(logger::Logger *logger, database::Database *database, device::Controller *device);
 
     public:
         uint32_t Count();
+        uint32_t Generation(); // Bumped whenever the records change
         Role *Get(const char *name);
-        Role *List(uint32_t *size);
+        void List(database::ResultSet<Role> *roles);
+        void List(database::ResultSet<Role> *roles, uint32_t limit, database::Cursor *cursor);
         void Set(Role *role);
         void Delete(const char *name);
-        void RemoveDeviceFromAllRoles(const char *device);
+        void RemoveDeviceFromAllRoles(const char *device, database::WriteBatch *batch);
         void Drop();
         bool Includes(const char *role, const char *device);
         bool Includes(Role *role, const char *device);
         bool Includes(const char *role, device::Device *device);
         bool Includes(Role *role, device::Device *device);
+        void Devices(const char *role, device::Slots *devices); // Empty if the role does not exist
     };
 }
\ No newline at end of file
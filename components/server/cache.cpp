@@ -0,0 +1,166 @@
+#include <stdlib.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_http_server.h"
+#include "database.hpp"
+#include "server.hpp"
+
+namespace server
+{
+    Cache *Cache::New(uint32_t budget)
+    {
+        Cache *cache = new Cache();
+
+        cache->head = NULL;
+        cache->tail = NULL;
+        cache->budget = budget;
+        cache->size = 0;
+        cache->entries = 0;
+        cache->hits = 0;
+        cache->misses = 0;
+
+        return cache;
+    }
+
+    Cache::Entry *Cache::find(const char *uri, const char *role)
+    {
+        // Roles are interned, so they are compared by pointer
+        for (Entry *entry = this->head; entry != NULL; entry = entry->Next)
+            if (entry->Role == role && !strcmp(entry->URI, uri))
+                return entry;
+
+        return NULL;
+    }
+
+    void Cache::link(Entry *entry)
+    {
+        entry->Prev = NULL;
+        entry->Next = this->head;
+
+        if (this->head != NULL)
+            this->head->Prev = entry;
+        else
+            this->tail = entry;
+
+        this->head = entry;
+    }
+
+    void Cache::unlink(Entry *entry)
+    {
+        if (entry->Prev != NULL)
+            entry->Prev->Next = entry->Next;
+        else
+            this->head = entry->Next;
+
+        if (entry->Next != NULL)
+            entry->Next->Prev = entry->Prev;
+        else
+            this->tail = entry->Prev;
+    }
+
+    void Cache::remove(Entry *entry)
+    {
+        this->unlink(entry);
+
+        this->size -= entry->Size;
+        this->entries--;
+
+        free((void *)entry->URI);
+        free((void *)entry->Body);
+        delete entry;
+    }
+
+    bool Cache::Send(httpd_req_t *request, const char *role, uint32_t generation)
+    {
+        Entry *entry = this->find(request->uri, role);
+        if (entry == NULL)
+        {
+            this->misses++;
+            return false;
+        }
+
+        // Responses of previous generations will never be served again
+        if (entry->Generation != generation)
+        {
+            this->remove(entry);
+            this->misses++;
+            return false;
+        }
+
+        // Promote entry to most recently used
+        this->unlink(entry);
+        this->link(entry);
+
+        this->hits++;
+
+        ESP_ERROR_CHECK(httpd_resp_set_status(request, Statuses::_200));
+        ESP_ERROR_CHECK(httpd_resp_set_type(request, ContentTypes::ApplicationJSON));
+        ESP_ERROR_CHECK(httpd_resp_send(request, entry->Body, entry->Length));
+
+        return true;
+    }
+
+    void Cache::Put(const char *uri, const char *role, uint32_t generation, const char *body, uint32_t length)
+    {
+        uint32_t size = sizeof(Entry) + strlen(uri) + 1 + length;
+
+        // Replace any stale entry
+        Entry *entry = this->find(uri, role);
+        if (entry != NULL)
+            this->remove(entry);
+
+        // Generations are shared by every page and role of a path, so the responses of previous ones are dropped now
+        // instead of waiting to be requested again or to reach the tail
+        size_t path = strcspn(uri, "?");
+        entry = this->head;
+        while (entry != NULL)
+        {
+            Entry *next = entry->Next;
+            if (entry->Generation != generation && strcspn(entry->URI, "?") == path && !strncmp(entry->URI, uri, path))
+                this->remove(entry);
+            entry = next;
+        }
+
+        // Responses bigger than the whole budget are never cached
+        if (size > this->budget)
+            return;
+
+        // Evict least recently used entries until the response fits
+        while (this->size + size > this->budget)
+            this->remove(this->tail);
+
+        // Bodies are kept in PSRAM when available, and give way to everything else when memory runs out
+        char *copy = (char *)heap_caps_malloc_prefer(length, 2, MALLOC_CAP_SPIRAM, MALLOC_CAP_DEFAULT);
+        while (copy == NULL && this->tail != NULL)
+        {
+            this->remove(this->tail);
+            copy = (char *)heap_caps_malloc_prefer(length, 2, MALLOC_CAP_SPIRAM, MALLOC_CAP_DEFAULT);
+        }
+        if (copy == NULL)
+            return;
+
+        memcpy(copy, body, length);
+
+        entry = new Entry();
+        entry->URI = strdup(uri);
+        entry->Role = role;
+        entry->Generation = generation;
+        entry->Body = copy;
+        entry->Length = length;
+        entry->Size = size;
+
+        this->link(entry);
+        this->size += size;
+        this->entries++;
+    }
+
+    void Cache::Stats(database::CacheStats *stats)
+    {
+        stats->Hits = this->hits;
+        stats->Misses = this->misses;
+        stats->Entries = this->entries;
+        stats->Size = this->size;
+        stats->Budget = this->budget;
+    }
+}
\ No newline at end of file
@@ -1,5 +1,9 @@
 #include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include "sdkconfig.h"
 #include "esp_err.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
@@ -10,6 +14,8 @@
 #include "http_parser.h"
 #include "cJSON.h"
 #include "esp_vfs_fat.h"
+#include "esp_partition.h"
+#include "sha/sha_block.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_chip_info.h"
@@ -17,6 +23,7 @@
 #include "esp_idf_version.h"
 #include "esp_app_desc.h"
 #include "esp_system.h"
+#include "esp_random.h"
 #include "esp_flash.h"
 #include "esp_psram.h"
 #include "logger.hpp"
@@ -31,6 +38,181 @@
 
 namespace server
 {
+    Writer::Writer(httpd_req_t *request, database::Arena *arena)
+    {
+        this->request = request;
+        this->arena = arena;
+        this->buffer = (char *)arena->Allocate(WRITER_BUFFER_SIZE);
+        this->size = 0;
+        this->separated = false;
+        this->err = ESP_OK;
+        this->capture = NULL;
+        this->captured = 0;
+    }
+
+    void Writer::send(const char *data, size_t size)
+    {
+        if (this->err != ESP_OK)
+            return;
+
+        // Stop capturing as soon as the response outgrows the capture
+        if (this->capture != NULL)
+        {
+            if (this->captured + size <= MAX_CACHED_SIZE)
+            {
+                memcpy(this->capture + this->captured, data, size);
+                this->captured += size;
+            }
+            else
+                this->capture = NULL;
+        }
+
+        this->err = httpd_resp_send_chunk(this->request, data, size);
+    }
+
+    void Writer::flush()
+    {
+        if (this->size == 0)
+            return;
+
+        this->send(this->buffer, this->size);
+        this->size = 0;
+    }
+
+    bool Writer::print(cJSON *item)
+    {
+        char *dst = this->buffer + this->size;
+        size_t available = WRITER_BUFFER_SIZE - this->size;
+
+        if (this->separated)
+        {
+            if (available < 2)
+                return false;
+
+            *dst++ = ',';
+            available--;
+        }
+
+        // cJSON leaves the buffer in an unknown state when the item does not fit, so nothing is kept
+        if (!cJSON_PrintPreallocated(item, dst, available, false))
+            return false;
+
+        this->size = dst - this->buffer + strlen(dst);
+
+        return true;
+    }
+
+    esp_err_t Writer::Begin(const char *status)
+    {
+        // Set appropiate content type and status
+        this->err = httpd_resp_set_status(this->request, status);
+        if (this->err != ESP_OK)
+            return this->err;
+
+        this->err = httpd_resp_set_type(this->request, ContentTypes::ApplicationJSON);
+        if (this->err != ESP_OK)
+            return this->err;
+
+        return ESP_OK;
+    }
+
+    void Writer::Write(const char *str)
+    {
+        this->separated = false;
+
+        size_t length = strlen(str);
+        while (length > 0 && this->err == ESP_OK)
+        {
+            if (this->size == WRITER_BUFFER_SIZE)
+                this->flush();
+
+            size_t count = WRITER_BUFFER_SIZE - this->size;
+            if (count > length)
+                count = length;
+
+            memcpy(this->buffer + this->size, str, count);
+            this->size += count;
+            str += count;
+            length -= count;
+        }
+    }
+
+    void Writer::Item(cJSON *item)
+    {
+        if (this->err != ESP_OK)
+            return;
+
+        // Print in place, or in an empty buffer if what is left is not enough
+        if (!this->print(item))
+        {
+            this->flush();
+
+            // Items larger than the buffer are printed on their own and sent as a single chunk
+            if (this->err == ESP_OK && !this->print(item))
+            {
+                if (this->separated)
+                    this->Write(",");
+                this->flush();
+
+                char *str = cJSON_PrintUnformatted(item);
+                this->send(str, strlen(str));
+                cJSON_free(str);
+            }
+        }
+
+        this->separated = true;
+    }
+
+    esp_err_t Writer::End()
+    {
+        this->flush();
+
+        // An empty chunk terminates the response
+        if (this->err == ESP_OK)
+            this->err = httpd_resp_send_chunk(this->request, NULL, 0);
+
+        return this->err;
+    }
+
+    void Writer::Capture()
+    {
+        // Released along with the request
+        this->capture = (char *)this->arena->Allocate(MAX_CACHED_SIZE);
+        this->captured = 0;
+    }
+
+    const char *Writer::Captured(size_t *size) const
+    {
+        if (this->err != ESP_OK || this->capture == NULL)
+            return NULL;
+
+        *size = this->captured;
+
+        return this->capture;
+    }
+
+    Requester::Requester()
+    {
+        this->Name = NULL;
+        this->Role = NULL;
+        this->Admin = false;
+    }
+
+    Requester::~Requester()
+    {
+        free((void *)this->Name);
+    }
+
+    bool Requester::Allows(device::Device *device) const
+    {
+        return this->Admin || this->Devices.Has(device->Slot);
+    }
+
+    bool Requester::Allows(const char *device) const
+    {
+        return this->Admin || this->Devices.Has(device::Controller::Instance->Slot(device));
+    }
+
     Server *Server::New(logger::Logger *logger, database::Database *database, provisioner::Provisioner *provisioner,
                         chron::Controller *chron, device::Transmitter *transmitter, device::Receiver *receiver,
                         user::Controller *user, device::Controller *device, trigger::Controller *trigger,
@@ -54,6 +236,9 @@ namespace server
         Instance->role = role;
 
         Instance->espServer = NULL;
+        Instance->arena = new database::Arena(true);
+        Instance->boot = esp_random();
+        Instance->cache = Cache::New(CACHE_SIZE);
 
         // Register Wi-Fi station, softAP and LwIP event callbacks
         ESP_ERROR_CHECK(esp_event_handler_instance_register(
@@ -65,13 +250,25 @@ namespace server
         ESP_ERROR_CHECK(esp_event_handler_instance_register(
             IP_EVENT, IP_EVENT_STA_GOT_IP, Instance->ipFunc, NULL, NULL));
 
-        // Mount FAT filesystem from static partition
-        esp_vfs_fat_mount_config_t cfg = {
-            .format_if_mount_failed = false,
-            .max_files = MAX_CLIENTS,
-            .allocation_unit_size = CONFIG_WL_SECTOR_SIZE,
-        };
-        ESP_ERROR_CHECK(esp_vfs_fat_spiflash_mount_rw_wl(ROOT, PARTITION, &cfg, &Instance->fsHandle));
+        // Map the frontend when its bundle is flashed raw into the static partition
+        const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, PARTITION);
+        if (partition == NULL)
+            ESP_ERROR_CHECK(ESP_ERR_NOT_FOUND);
+
+        Instance->frontend = NULL;
+        Instance->frontendMissing = false;
+        if (partition->subtype != ESP_PARTITION_SUBTYPE_DATA_FAT)
+            Instance->mapFrontend(partition);
+        // Otherwise mount FAT filesystem from static partition
+        else
+        {
+            esp_vfs_fat_mount_config_t cfg = {
+                .format_if_mount_failed = false,
+                .max_files = MAX_CLIENTS,
+                .allocation_unit_size = CONFIG_WL_SECTOR_SIZE,
+            };
+            ESP_ERROR_CHECK(esp_vfs_fat_spiflash_mount_rw_wl(ROOT, PARTITION, &cfg, &Instance->fsHandle));
+        }
 
         // Increase HTTPD log level, is too verbose
         esp_log_level_set("httpd_uri", ESP_LOG_ERROR);
@@ -123,42 +320,42 @@ namespace server
         ESP_ERROR_CHECK(httpd_register_err_handler(this->espServer, HTTPD_505_VERSION_NOT_SUPPORTED, this->errorHandler));
 
         // Register api handlers
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiPostRegisterURIHandler));
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiPostLoginURIHandler));
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiPostLogoutURIHandler));
-
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiGetUsersURIHandler));
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiGetUserURIHandler));
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiPutUserURIHandler));
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiDeleteUserURIHandler));
-
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiGetDevicesURIHandler));
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiGetDeviceURIHandler));
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiPostDevicesURIHandler));
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiPutDeviceURIHandler));
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiDeleteDeviceURIHandler));
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiPostDeviceActuateURIHandler));
-
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiGetTriggersURIHandler));
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiGetTriggerURIHandler));
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiPostTriggersURIHandler));
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiPutTriggerURIHandler));
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiDeleteTriggerURIHandler));
-
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiGetRolesURIHandler));
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiGetRoleURIHandler));
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiPostRolesURIHandler));
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiPutRoleURIHandler));
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiDeleteRoleURIHandler));
-
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiGetSystemInfoURIHandler));
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiGetSystemTimeURIHandler));
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiGetSystemWiFiURIHandler));
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiPutSystemWiFiURIHandler));
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->apiDeleteSystemResetURIHandler));
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiPostRegisterURIHandler));
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiPostLoginURIHandler));
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiPostLogoutURIHandler));
+
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiGetUsersURIHandler));
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiGetUserURIHandler));
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiPutUserURIHandler));
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiDeleteUserURIHandler));
+
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiGetDevicesURIHandler));
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiGetDeviceURIHandler));
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiPostDevicesURIHandler));
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiPutDeviceURIHandler));
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiDeleteDeviceURIHandler));
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiPostDeviceActuateURIHandler));
+
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiGetTriggersURIHandler));
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiGetTriggerURIHandler));
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiPostTriggersURIHandler));
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiPutTriggerURIHandler));
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiDeleteTriggerURIHandler));
+
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiGetRolesURIHandler));
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiGetRoleURIHandler));
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiPostRolesURIHandler));
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiPutRoleURIHandler));
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiDeleteRoleURIHandler));
+
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiGetSystemInfoURIHandler));
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiGetSystemTimeURIHandler));
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiGetSystemWiFiURIHandler));
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiPutSystemWiFiURIHandler));
+        ESP_ERROR_CHECK(this->registerHandler(&this->apiDeleteSystemResetURIHandler));
 
         // Register frontend handler, note that it has to be the last one to catch all other URLs
-        ESP_ERROR_CHECK(httpd_register_uri_handler(this->espServer, &this->frontURIHandler));
+        ESP_ERROR_CHECK(this->registerHandler(&this->frontURIHandler));
 
         this->logger->Debug(TAG, "Started HTTP server on port :%d", cfg.server_port);
     }
@@ -176,6 +373,29 @@ namespace server
         this->logger->Debug(TAG, "Stopped HTTP server");
     }
 
+    esp_err_t Server::registerHandler(httpd_uri_t *uri)
+    {
+        // Route the request through requestHandler, unless it was already on a previous start
+        if (uri->handler != requestHandler)
+        {
+            uri->user_ctx = (void *)uri->handler;
+            uri->handler = requestHandler;
+        }
+
+        return httpd_register_uri_handler(this->espServer, uri);
+    }
+
+    esp_err_t Server::requestHandler(httpd_req_t *request)
+    {
+        esp_err_t (*handler)(httpd_req_t *) = (esp_err_t(*)(httpd_req_t *))request->user_ctx;
+
+        // Requests are handled one at a time by the server task, so they can share a single arena
+        esp_err_t err = handler(request);
+        Instance->arena->Reset();
+
+        return err;
+    }
+
     esp_err_t Server::sendFile(httpd_req_t *request, const char *path, const char *status)
     {
         esp_err_t err;
@@ -240,6 +460,85 @@ namespace server
         return ESP_OK;
     }
 
+    void Server::mapFrontend(const esp_partition_t *partition)
+    {
+        // Raw partitions do not tell the length of what they hold, so it is measured at build time
+        this->frontendSize = FRONTEND_BUNDLE_SIZE;
+        if (this->frontendSize < 2 || this->frontendSize > partition->size)
+        {
+            this->logger->Error(TAG, "frontend bundle of %u bytes does not fit the static partition", (unsigned int)this->frontendSize);
+            this->frontendMissing = true;
+            return;
+        }
+
+        ESP_ERROR_CHECK(esp_partition_mmap(partition, 0, this->frontendSize, ESP_PARTITION_MMAP_DATA,
+                                           (const void **)&this->frontend, &this->frontendHandle));
+
+        // The partition might have never been flashed, or hold something else, as nothing tells
+        if ((uint8_t)this->frontend[0] != 0x1f || (uint8_t)this->frontend[1] != 0x8b)
+        {
+            this->logger->Error(TAG, "static partition does not hold a gzipped frontend bundle");
+            esp_partition_munmap(this->frontendHandle);
+            this->frontend = NULL;
+            this->frontendMissing = true;
+            return;
+        }
+
+        // Tag the bundle by its content, with as much of the digest as fits
+        uint8_t digest[32];
+        esp_sha(SHA2_256, (const unsigned char *)this->frontend, this->frontendSize, digest);
+
+        this->frontendETag[0] = '"';
+        for (int i = 0; i < (ETAG_SIZE - 2) / 2; i++)
+            sprintf(&this->frontendETag[1 + i * 2], "%02x", digest[i]);
+        strcpy(&this->frontendETag[ETAG_SIZE - 1], "\"");
+    }
+
+    esp_err_t Server::sendFrontend(httpd_req_t *request)
+    {
+        esp_err_t err;
+
+        err = httpd_resp_set_hdr(request, Headers::ETag, this->frontendETag);
+        if (err != ESP_OK)
+            return err;
+
+        // Clients that already have the bundle only need to know it did not change
+        if (this->matchETag(request, this->frontendETag))
+        {
+            err = httpd_resp_set_status(request, Statuses::_304);
+            if (err != ESP_OK)
+                return err;
+
+            return httpd_resp_send(request, NULL, 0);
+        }
+
+        // Set appropiate content type, encoding and status
+        err = httpd_resp_set_hdr(request, Headers::ContentEncoding, ContentEncodings::GZIP);
+        if (err != ESP_OK)
+            return err;
+
+        err = httpd_resp_set_status(request, Statuses::_200);
+        if (err != ESP_OK)
+            return err;
+
+        err = httpd_resp_set_type(request, ContentTypes::TextHTML);
+        if (err != ESP_OK)
+            return err;
+
+        // Send it straight from the flash cache all at once, so its length is known upfront and the connection kept alive
+        err = httpd_resp_send(request, this->frontend, this->frontendSize);
+        if (err != ESP_OK)
+        {
+            // On large responses client may reset the connection suddenly, ignore it and do not panic
+            if (errno == ECONNRESET || errno == ENOTCONN)
+                return ESP_OK;
+
+            return err;
+        }
+
+        return ESP_OK;
+    }
+
     esp_err_t Server::sendJSON(httpd_req_t *request, cJSON *json, const char *status)
     {
         esp_err_t err;
@@ -253,10 +552,17 @@ namespace server
         if (err != ESP_OK)
             return err;
 
+        // Print into the request arena, growing the buffer until the body fits
+        uint32_t size = RESPONSE_BUFFER_SIZE;
+        char *body = (char *)this->arena->Allocate(size);
+        while (!cJSON_PrintPreallocated(json, body, size, false))
+        {
+            size *= 2;
+            body = (char *)this->arena->Allocate(size);
+        }
+
         // Send all body at once
-        const char *body = cJSON_PrintUnformatted(json);
         err = httpd_resp_send(request, body, HTTPD_RESP_USE_STRLEN);
-        free((void *)body);
         if (err != ESP_OK)
             return err;
 
@@ -285,12 +591,12 @@ namespace server
     {
         esp_err_t err;
 
-        char body[MAX_REQUEST_CONTENT_SIZE + 1];
-
         // Check if request content fits in body buffer
         if (request->content_len > MAX_REQUEST_CONTENT_SIZE)
             return ESP_ERR_NO_MEM;
 
+        char *body = (char *)this->arena->Allocate(request->content_len + 1);
+
         // Trying to receive with no content generates an error
         if (request->content_len < 2)
         {
@@ -317,10 +623,8 @@ namespace server
         return ESP_OK;
     }
 
-    user::User *Server::checkToken(httpd_req_t *request)
+    Requester *Server::checkToken(httpd_req_t *request)
     {
-        user::User *user = NULL;
-
         char header[MAX_REQUEST_HEADER_SIZE + 1];
 
         uint32_t size = httpd_req_get_hdr_value_len(request, Headers::Authorization);
@@ -329,7 +633,7 @@ namespace server
         if (size > MAX_REQUEST_HEADER_SIZE)
             return NULL;
 
-        // Authorization header should be present and at least user::TOKEN_SIZE
+        // Authorization header should be present and at least user::TOKEN_SIZE, signed tokens are longer
         if (size < user::TOKEN_SIZE)
             return NULL;
 
@@ -338,6 +642,8 @@ namespace server
 
         // Search for name:token delimiter
         char *del = strchr(header, ':');
+        if (del == NULL)
+            return NULL;
 
         // Replace delimiter with NULL to split the header
         *del = '\0';
@@ -345,25 +651,140 @@ namespace server
         char *token = del + 1;
         char *name = header;
 
-        // Get user
-        user = Instance->user->Get(name);
+        // Check the token against the user session
+        user::User *user = Instance->user->Authenticate(name, token, Instance->chron->Now());
         if (user == NULL)
             return NULL;
 
-        // Check if tokens match
-        if (strcmp(token, user->Token))
+        // Resolve the authorization of the user once for the whole request
+        Requester *requester = new Requester();
+        requester->Name = user->Name;
+        requester->Role = user->Role;
+        requester->Admin = !strcmp(user->Role, role::System::Admin.Name);
+        Instance->role->Devices(user->Role, &requester->Devices);
+
+        user->Name = NULL;
+        delete user;
+
+        return requester;
+    }
+
+    const char *Server::getPathParam(httpd_req_t *request)
+    {
+        // Search for the last path delimiter and return what's next, released along with the request
+        return database::Arena::Copy(this->arena, strrchr(request->uri, '/') + 1);
+    }
+
+    esp_err_t Server::getPageParams(httpd_req_t *request, uint32_t *limit, database::Cursor *cursor)
+    {
+        esp_err_t err;
+
+        char query[MAX_REQUEST_QUERY_SIZE + 1];
+        char param[database::CURSOR_TOKEN_SIZE];
+
+        // Lists are not paginated unless a limit is given
+        *limit = 0;
+
+        uint32_t size = httpd_req_get_url_query_len(request);
+        if (size < 1)
+            return ESP_OK;
+
+        // Check if request query fits in query buffer
+        if (size > MAX_REQUEST_QUERY_SIZE)
+            return ESP_ERR_INVALID_SIZE;
+
+        ESP_ERROR_CHECK(httpd_req_get_url_query_str(request, query, size + 1));
+
+        err = httpd_query_key_value(query, "limit", param, sizeof(param));
+        if (err == ESP_ERR_NOT_FOUND)
+            return ESP_OK;
+        else if (err != ESP_OK)
+            return ESP_ERR_INVALID_ARG;
+
+        char *end;
+        long value = strtol(param, &end, 10);
+        if (*end != '\0' || value < 1 || value > MAX_PAGE_LIMIT)
+            return ESP_ERR_INVALID_ARG;
+
+        *limit = value;
+
+        // Start from the beginning without a cursor
+        err = httpd_query_key_value(query, "cursor", param, sizeof(param));
+        if (err == ESP_ERR_NOT_FOUND)
+            return ESP_OK;
+        else if (err != ESP_OK)
+            return ESP_ERR_INVALID_ARG;
+
+        return cursor->Decode(param);
+    }
+
+    void Server::addCursor(cJSON *json, database::Cursor *cursor)
+    {
+        // The cursor of the next page, if any
+        if (!cursor->More)
         {
-            delete user;
-            return NULL;
+            cJSON_AddNullToObject(json, "cursor");
+            return;
         }
 
-        return user;
+        char token[database::CURSOR_TOKEN_SIZE];
+        cursor->Encode(token);
+        cJSON_AddStringToObject(json, "cursor", token);
     }
 
-    const char *Server::getPathParam(httpd_req_t *request)
+    void Server::writeCursor(Writer *writer, database::Cursor *cursor)
+    {
+        // The cursor of the next page, if any
+        if (!cursor->More)
+        {
+            writer->Write(",\"cursor\":null");
+            return;
+        }
+
+        // Tokens are hexadecimal, so they need no escaping
+        char token[database::CURSOR_TOKEN_SIZE];
+        cursor->Encode(token);
+        writer->Write(",\"cursor\":\"");
+        writer->Write(token);
+        writer->Write("\"");
+    }
+
+    bool Server::matchETag(httpd_req_t *request, const char *etag)
+    {
+        char header[MAX_REQUEST_HEADER_SIZE + 1];
+
+        uint32_t size = httpd_req_get_hdr_value_len(request, Headers::IfNoneMatch);
+        if (size < ETAG_SIZE || size > MAX_REQUEST_HEADER_SIZE)
+            return false;
+
+        ESP_ERROR_CHECK(httpd_req_get_hdr_value_str(request, Headers::IfNoneMatch, header, size + 1));
+
+        // The header can hold a list of tags, possibly weak
+        return strstr(header, etag) != NULL;
+    }
+
+    bool Server::checkETag(httpd_req_t *request, Requester *reqUser, uint32_t generation, char etag[ETAG_SIZE + 1])
     {
-        // Search for the last path delimiter and return what's next
-        return strdup(strrchr(request->uri, '/') + 1);
+        // Responses only change with the records they are built from and the role they are filtered for,
+        // which is compared by its interned pointer. The tag must outlive the response, as headers are not copied.
+        snprintf(etag, ETAG_SIZE + 1, "\"%08" PRIx32 "%08" PRIx32 "%08" PRIx32 "\"", this->boot,
+                 (uint32_t)(uintptr_t)reqUser->Role, generation);
+
+        if (!this->matchETag(request, etag))
+            return false;
+
+        this->tagResponse(request, etag);
+        ESP_ERROR_CHECK(httpd_resp_set_status(request, Statuses::_304));
+        ESP_ERROR_CHECK(httpd_resp_send(request, NULL, 0));
+
+        return true;
+    }
+
+    void Server::tagResponse(httpd_req_t *request, const char *etag)
+    {
+        // Only successful responses are tagged, and clients revalidate them every time, which is cheap while nothing changes
+        ESP_ERROR_CHECK(httpd_resp_set_hdr(request, Headers::ETag, etag));
+        ESP_ERROR_CHECK(httpd_resp_set_hdr(request, Headers::CacheControl, "no-cache"));
     }
 
     void Server::apFunc(void *args, esp_event_base_t base, int32_t id, void *data)
@@ -475,29 +896,38 @@ namespace server
 
     esp_err_t Server::frontHandler(httpd_req_t *request)
     {
-        // On home path serve the Gzipped frontend from FATFS static partition
+        // On home path serve the Gzipped frontend from the static partition
         if (!strcmp(request->uri, "/") || !strcmp(request->uri, ""))
         {
-            // Set Cache Control header so clients load the frontend faster
-            ESP_ERROR_CHECK(httpd_resp_set_hdr(request, Headers::CacheControl, "max-age=604800, stale-while-revalidate=86400, stale-if-error=86400"));
+            // There is nothing to serve when the raw partition does not hold a bundle
+            if (Instance->frontendMissing)
+            {
+                ESP_ERROR_CHECK(Instance->sendError(request, Errors::ServerGeneric, "Frontend is not flashed"));
+                return ESP_OK;
+            }
+
+            // Clients revalidate the frontend on every load, which only costs a 304 while it did not change
+            ESP_ERROR_CHECK(httpd_resp_set_hdr(request, Headers::CacheControl, "no-cache"));
 
             // Serve Gzipped frontend failing silently because it is a very big file
-            esp_err_t err = Instance->sendFile(request, FRONTEND, Statuses::_200);
+            esp_err_t err;
+            if (Instance->frontend != NULL)
+                err = Instance->sendFrontend(request);
+            else
+                err = Instance->sendFile(request, FRONTEND, Statuses::_200);
             if (err != ESP_OK)
                 Instance->logger->Error(TAG, "error serving frontend: %d", err);
 
             return ESP_OK;
         }
 
-        char *location = NULL;
-
         // If there are no users (ignoring the System default) redirect to onboarding page /#/onboarding
         if (Instance->user->Count() <= 1)
             ESP_ERROR_CHECK(httpd_resp_set_hdr(request, Headers::Location, "/#/onboarding"));
         // Otherwise redirect to the frontend hash-based navigation: /#/:URI
         else
         {
-            location = (char *)malloc(strlen(request->uri) + 2 + 1);
+            char *location = (char *)Instance->arena->Allocate(strlen(request->uri) + 2 + 1);
             strcpy(location, "/#");
             ESP_ERROR_CHECK(httpd_resp_set_hdr(request, Headers::Location, strcat(location, request->uri)));
         }
@@ -516,8 +946,6 @@ namespace server
             ESP_ERROR_CHECK(httpd_resp_send(request, NULL, 0));
         }
 
-        free((void *)location);
-
         return ESP_OK;
     }
 
@@ -558,9 +986,14 @@ namespace server
 
         Instance->user->Set(&newUser);
 
+        // Issue a signed authentication token as well
+        char accessToken[user::SIGNED_TOKEN_SIZE + 1];
+        Instance->user->IssueToken(&newUser, Instance->chron->Now(), accessToken);
+
         // Send response JSON
         cJSON *resJSON = newUser.JSON();
         cJSON_DeleteItemFromObject(resJSON, "password");
+        cJSON_AddStringToObject(resJSON, "access_token", accessToken);
         ESP_ERROR_CHECK(Instance->sendJSON(request, resJSON, Statuses::_200));
         cJSON_Delete(resJSON);
 
@@ -614,10 +1047,15 @@ namespace server
         // Save user
         Instance->user->Set(user);
 
+        // Issue a signed authentication token as well
+        char accessToken[user::SIGNED_TOKEN_SIZE + 1];
+        Instance->user->IssueToken(user, Instance->chron->Now(), accessToken);
+
         // Send response JSON
         cJSON *resJSON = user->JSON();
         delete user;
         cJSON_DeleteItemFromObject(resJSON, "password");
+        cJSON_AddStringToObject(resJSON, "access_token", accessToken);
         ESP_ERROR_CHECK(Instance->sendJSON(request, resJSON, Statuses::_200));
         cJSON_Delete(resJSON);
 
@@ -627,21 +1065,31 @@ namespace server
     esp_err_t Server::apiPostLogoutHandler(httpd_req_t *request)
     {
         // Authenticate request user
-        user::User *reqUser = Instance->checkToken(request);
+        Requester *reqUser = Instance->checkToken(request);
         if (reqUser == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
             return ESP_FAIL;
         }
 
-        // Empty authentication token
-        free((void *)reqUser->Token);
-        reqUser->Token = strdup("");
+        // Authenticated users only hold their name and role, so the user is read to be saved
+        user::User *user = Instance->user->Get(reqUser->Name);
+        delete reqUser;
+        if (user == NULL)
+        {
+            ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
+            return ESP_FAIL;
+        }
+
+        // Empty authentication token and revoke the signed ones
+        free((void *)user->Token);
+        user->Token = strdup("");
+        user->Generation++;
 
         // Save user
-        Instance->user->Set(reqUser);
+        Instance->user->Set(user);
 
-        delete reqUser;
+        delete user;
 
         // Send response JSON
         cJSON *resJSON = cJSON_CreateObject();
@@ -654,49 +1102,98 @@ namespace server
     esp_err_t Server::apiGetUsersHandler(httpd_req_t *request)
     {
         // Authenticate request user
-        user::User *reqUser = Instance->checkToken(request);
+        Requester *reqUser = Instance->checkToken(request);
         if (reqUser == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
             return ESP_FAIL;
         }
 
-        delete reqUser;
+        // Get pagination query params
+        uint32_t limit;
+        database::Cursor cursor;
+        if (Instance->getPageParams(request, &limit, &cursor) != ESP_OK)
+        {
+            delete reqUser;
+            ESP_ERROR_CHECK(Instance->sendError(request, Errors::InvalidRequest, "Invalid pagination"));
+            return ESP_FAIL;
+        }
 
-        // Get all users
-        uint32_t size;
-        user::User *users = Instance->user->List(&size);
+        // Answer without reading the users when the client already has them
+        uint32_t generation = Instance->user->Generation();
+        char etag[ETAG_SIZE + 1];
+        if (Instance->checkETag(request, reqUser, generation, etag))
+        {
+            delete reqUser;
+            return ESP_OK;
+        }
 
-        // Send response JSON
-        cJSON *resJSON = cJSON_CreateObject();
-        cJSON *usersJSON = cJSON_AddArrayToObject(resJSON, "users");
+        Instance->tagResponse(request, etag);
 
-        for (int i = 0; i < size; i++)
+        // Or with the response rendered for any role, as users are not filtered, unless it changed since
+        const char *role = NULL;
+        if (Instance->cache->Send(request, role, generation))
         {
-            cJSON *userJSON = users[i].JSON();
+            delete reqUser;
+            return ESP_OK;
+        }
+
+        delete reqUser;
+
+        // Stream all users or a page of them while they are read
+        Writer writer(request, Instance->arena);
+        writer.Capture();
+        ESP_ERROR_CHECK(writer.Begin(Statuses::_200));
+        writer.Write("{\"users\":[");
+
+        user::user_list_cb_t list = [](user::User *user, void *context)
+        {
+            cJSON *userJSON = user->JSON();
             cJSON_DeleteItemFromObject(userJSON, "password");
             cJSON_DeleteItemFromObject(userJSON, "token");
-            cJSON_AddItemToArray(usersJSON, userJSON);
-        }
+            ((Writer *)context)->Item(userJSON);
+            cJSON_Delete(userJSON);
+        };
 
-        delete[] users;
+        if (limit > 0)
+            Instance->user->List(list, &writer, limit, &cursor);
+        else
+            Instance->user->List(list, &writer);
 
-        ESP_ERROR_CHECK(Instance->sendJSON(request, resJSON, Statuses::_200));
-        cJSON_Delete(resJSON);
+        writer.Write("]");
+        if (limit > 0)
+            Instance->writeCursor(&writer, &cursor);
+        writer.Write("}");
 
-        return ESP_OK;
+        esp_err_t err = writer.End();
+
+        // Keep the response for the next requests that would render the same
+        size_t size;
+        const char *body = writer.Captured(&size);
+        if (body != NULL)
+            Instance->cache->Put(request->uri, role, generation, body, size);
+
+        return err;
     }
 
     esp_err_t Server::apiGetUserHandler(httpd_req_t *request)
     {
         // Authenticate request user
-        user::User *reqUser = Instance->checkToken(request);
+        Requester *reqUser = Instance->checkToken(request);
         if (reqUser == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
             return ESP_FAIL;
         }
 
+        // Answer without reading the user when the client already has it
+        char etag[ETAG_SIZE + 1];
+        if (Instance->checkETag(request, reqUser, Instance->user->Generation(), etag))
+        {
+            delete reqUser;
+            return ESP_OK;
+        }
+
         delete reqUser;
 
         // Get name path param
@@ -704,7 +1201,6 @@ namespace server
 
         // Get user
         user::User *user = Instance->user->Get(name);
-        free((void *)name);
         if (user == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::InvalidRequest, "User doesn't exist"));
@@ -716,6 +1212,7 @@ namespace server
         delete user;
         cJSON_DeleteItemFromObject(resJSON, "password");
         cJSON_DeleteItemFromObject(resJSON, "token");
+        Instance->tagResponse(request, etag);
         ESP_ERROR_CHECK(Instance->sendJSON(request, resJSON, Statuses::_200));
         cJSON_Delete(resJSON);
 
@@ -725,7 +1222,7 @@ namespace server
     esp_err_t Server::apiPutUserHandler(httpd_req_t *request)
     {
         // Authenticate request user
-        user::User *reqUser = Instance->checkToken(request);
+        Requester *reqUser = Instance->checkToken(request);
         if (reqUser == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
@@ -739,14 +1236,12 @@ namespace server
         if (user::System::System.Equals(name))
         {
             delete reqUser;
-            free((void *)name);
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::NoPermission, "Cannot modify system users"));
             return ESP_FAIL;
         }
 
         // Get user
         user::User *user = Instance->user->Get(name);
-        free((void *)name);
         if (user == NULL)
         {
             delete reqUser;
@@ -755,7 +1250,7 @@ namespace server
         }
 
         // Check if it is the requesting user or it is an admin
-        if (!reqUser->Equals(user) && !Instance->user->Belongs(reqUser, &role::System::Admin))
+        if (!user->Equals(reqUser->Name) && !reqUser->Admin)
         {
             delete reqUser;
             delete user;
@@ -777,6 +1272,14 @@ namespace server
             Instance->user->HashPassword(cJSON_GetObjectItem(reqJSON, "password")->valuestring, password);
 
             user->Password = strdup(password);
+
+            // Revoke the authentication token and the signed ones issued with the old password
+            char token[user::TOKEN_SIZE + 1];
+            Instance->user->GenerateToken(token);
+
+            free((void *)user->Token);
+            user->Token = strdup(token);
+            user->Generation++;
         }
 
         // Update emoji if present
@@ -790,7 +1293,7 @@ namespace server
         if (cJSON_GetObjectItem(reqJSON, "role") != NULL)
         {
             // Check if the requesting user is an admin
-            if (!Instance->user->Belongs(reqUser, &role::System::Admin))
+            if (!reqUser->Admin)
             {
                 delete reqUser;
                 delete user;
@@ -810,8 +1313,7 @@ namespace server
                 return ESP_FAIL;
             }
 
-            free((void *)user->Role);
-            user->Role = strdup(role->Name);
+            user->Role = database::Pool::Intern(role->Name);
             delete role;
         }
 
@@ -835,7 +1337,7 @@ namespace server
     esp_err_t Server::apiDeleteUserHandler(httpd_req_t *request)
     {
         // Authenticate request user
-        user::User *reqUser = Instance->checkToken(request);
+        Requester *reqUser = Instance->checkToken(request);
         if (reqUser == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
@@ -849,14 +1351,12 @@ namespace server
         if (user::System::System.Equals(name))
         {
             delete reqUser;
-            free((void *)name);
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::NoPermission, "Cannot delete system users"));
             return ESP_FAIL;
         }
 
         // Get user
         user::User *user = Instance->user->Get(name);
-        free((void *)name);
         if (user == NULL)
         {
             delete reqUser;
@@ -865,7 +1365,7 @@ namespace server
         }
 
         // Check if it is the requesting user or it is an admin
-        if (!reqUser->Equals(user) && !Instance->user->Belongs(reqUser, &role::System::Admin))
+        if (!user->Equals(reqUser->Name) && !reqUser->Admin)
         {
             delete reqUser;
             delete user;
@@ -892,51 +1392,114 @@ namespace server
     esp_err_t Server::apiGetDevicesHandler(httpd_req_t *request)
     {
         // Authenticate request user
-        user::User *reqUser = Instance->checkToken(request);
+        Requester *reqUser = Instance->checkToken(request);
         if (reqUser == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
             return ESP_FAIL;
         }
 
-        // Get all devices
-        uint32_t size;
-        device::Device *devices = Instance->device->List(&size);
+        // Get pagination query params
+        uint32_t limit;
+        database::Cursor cursor;
+        if (Instance->getPageParams(request, &limit, &cursor) != ESP_OK)
+        {
+            delete reqUser;
+            ESP_ERROR_CHECK(Instance->sendError(request, Errors::InvalidRequest, "Invalid pagination"));
+            return ESP_FAIL;
+        }
 
-        // Send response JSON
-        cJSON *resJSON = cJSON_CreateObject();
-        cJSON *devicesJSON = cJSON_AddArrayToObject(resJSON, "devices");
+        // Answer without reading the devices when the client already has them
+        uint32_t generation = Instance->device->Generation() + Instance->role->Generation();
+        char etag[ETAG_SIZE + 1];
+        if (Instance->checkETag(request, reqUser, generation, etag))
+        {
+            delete reqUser;
+            return ESP_OK;
+        }
 
-        // Filter devices depending if the requesting user role includes it or it is an admin
-        for (int i = 0; i < size; i++)
-            if (Instance->role->Includes(reqUser->Role, &devices[i]) || Instance->user->Belongs(reqUser, &role::System::Admin))
-                cJSON_AddItemToArray(devicesJSON, devices[i].JSON());
+        Instance->tagResponse(request, etag);
+
+        // Or with the response rendered for the same role, unless it changed since
+        const char *role = reqUser->Role;
+        if (Instance->cache->Send(request, role, generation))
+        {
+            delete reqUser;
+            return ESP_OK;
+        }
+
+        typedef struct listArgs
+        {
+            Requester *reqUser;
+            Writer *writer;
+        } listArgs;
+
+        // Stream all devices or a page of them while they are read
+        Writer writer(request, Instance->arena);
+        writer.Capture();
+        ESP_ERROR_CHECK(writer.Begin(Statuses::_200));
+        writer.Write("{\"devices\":[");
+
+        listArgs args = {reqUser, &writer};
+        device::device_list_cb_t list = [](device::Device *device, void *context)
+        {
+            listArgs *args = (listArgs *)context;
+
+            // Filter devices depending if the requesting user role includes it or it is an admin
+            if (!args->reqUser->Allows(device))
+                return;
+
+            cJSON *deviceJSON = device->JSON();
+            args->writer->Item(deviceJSON);
+            cJSON_Delete(deviceJSON);
+        };
+
+        if (limit > 0)
+            Instance->device->List(list, &args, limit, &cursor);
+        else
+            Instance->device->List(list, &args);
 
         delete reqUser;
-        delete[] devices;
 
-        ESP_ERROR_CHECK(Instance->sendJSON(request, resJSON, Statuses::_200));
-        cJSON_Delete(resJSON);
+        writer.Write("]");
+        if (limit > 0)
+            Instance->writeCursor(&writer, &cursor);
+        writer.Write("}");
 
-        return ESP_OK;
+        esp_err_t err = writer.End();
+
+        // Keep the response for the next requests that would render the same
+        size_t size;
+        const char *body = writer.Captured(&size);
+        if (body != NULL)
+            Instance->cache->Put(request->uri, role, generation, body, size);
+
+        return err;
     }
 
     esp_err_t Server::apiGetDeviceHandler(httpd_req_t *request)
     {
         // Authenticate request user
-        user::User *reqUser = Instance->checkToken(request);
+        Requester *reqUser = Instance->checkToken(request);
         if (reqUser == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
             return ESP_FAIL;
         }
 
+        // Answer without reading the device when the client already has it
+        char etag[ETAG_SIZE + 1];
+        if (Instance->checkETag(request, reqUser, Instance->device->Generation() + Instance->role->Generation(), etag))
+        {
+            delete reqUser;
+            return ESP_OK;
+        }
+
         // Get name path param
         const char *name = Instance->getPathParam(request);
 
         // Get device
         device::Device *device = Instance->device->GetByName(name);
-        free((void *)name);
         if (device == NULL)
         {
             delete reqUser;
@@ -945,7 +1508,7 @@ namespace server
         }
 
         // Check if the requesting user role includes the device or it is an admin
-        if (!Instance->role->Includes(reqUser->Role, device) && !Instance->user->Belongs(reqUser, &role::System::Admin))
+        if (!reqUser->Allows(device))
         {
             delete device;
             delete reqUser;
@@ -958,6 +1521,7 @@ namespace server
         // Send response JSON
         cJSON *resJSON = device->JSON();
         delete device;
+        Instance->tagResponse(request, etag);
         ESP_ERROR_CHECK(Instance->sendJSON(request, resJSON, Statuses::_200));
         cJSON_Delete(resJSON);
 
@@ -967,7 +1531,7 @@ namespace server
     esp_err_t Server::apiPostDevicesHandler(httpd_req_t *request)
     {
         // Authenticate request user
-        user::User *reqUser = Instance->checkToken(request);
+        Requester *reqUser = Instance->checkToken(request);
         if (reqUser == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
@@ -1000,23 +1564,8 @@ namespace server
         }
 
         // Check if the subtype is valid
-        device::Context context;
-        cJSON *reqContext = cJSON_GetObjectItem(reqJSON, "context");
-
-        if (!strcmp(cJSON_GetObjectItem(reqJSON, "subtype")->valuestring, device::Subtypes::Button))
-        {
-            context.Button.Command = cJSON_GetObjectItem(reqContext, "command")->valuestring;
-            context.Button.Emoji = cJSON_GetObjectItem(reqContext, "emoji")->valuestring;
-        }
-        else if (!strcmp(cJSON_GetObjectItem(reqJSON, "subtype")->valuestring, device::Subtypes::Bistate))
-        {
-            context.Bistate.Identifier1 = cJSON_GetObjectItem(reqContext, "identifier1")->valuestring;
-            context.Bistate.Emoji1 = cJSON_GetObjectItem(reqContext, "emoji1")->valuestring;
-            context.Bistate.Identifier2 = cJSON_GetObjectItem(reqContext, "identifier2")->valuestring;
-            context.Bistate.Emoji2 = cJSON_GetObjectItem(reqContext, "emoji2")->valuestring;
-            context.Bistate.State = 0;
-        }
-        else
+        const device::DeviceKind *kind = device::DeviceKind::Find(cJSON_GetObjectItem(reqJSON, "subtype")->valuestring);
+        if (kind == NULL)
         {
             cJSON_Delete(reqJSON);
             delete reqUser;
@@ -1024,6 +1573,10 @@ namespace server
             return ESP_FAIL;
         }
 
+        device::Context context;
+        memset(&context, 0, sizeof(device::Context));
+        kind->Bind(cJSON_GetObjectItem(reqJSON, "context"), &context);
+
         // Create new device
         device::Device newDevice(
             cJSON_GetObjectItem(reqJSON, "name")->valuestring,
@@ -1051,7 +1604,7 @@ namespace server
     esp_err_t Server::apiPutDeviceHandler(httpd_req_t *request)
     {
         // Authenticate request user
-        user::User *reqUser = Instance->checkToken(request);
+        Requester *reqUser = Instance->checkToken(request);
         if (reqUser == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
@@ -1063,7 +1616,6 @@ namespace server
 
         // Get device
         device::Device *device = Instance->device->GetByName(name);
-        free((void *)name);
         if (device == NULL)
         {
             delete reqUser;
@@ -1072,7 +1624,7 @@ namespace server
         }
 
         // Check if the requesting user role includes the device or it is an admin
-        if (!Instance->role->Includes(reqUser->Role, device) && !Instance->user->Belongs(reqUser, &role::System::Admin))
+        if (!reqUser->Allows(device))
         {
             delete device;
             delete reqUser;
@@ -1095,25 +1647,13 @@ namespace server
         // Update context if present
         if (cJSON_GetObjectItem(reqJSON, "context") != NULL)
         {
-            cJSON *reqContext = cJSON_GetObjectItem(reqJSON, "context");
-
-            if (!strcmp(device->Subtype, device::Subtypes::Button))
-            {
-                free((void *)device->Context.Button.Command);
-                free((void *)device->Context.Button.Emoji);
-                device->Context.Button.Command = strdup(cJSON_GetObjectItem(reqContext, "command")->valuestring);
-                device->Context.Button.Emoji = strdup(cJSON_GetObjectItem(reqContext, "emoji")->valuestring);
-            }
-            else if (!strcmp(device->Subtype, device::Subtypes::Bistate))
+            if (device->Kind != NULL)
             {
-                free((void *)device->Context.Bistate.Identifier1);
-                free((void *)device->Context.Bistate.Emoji1);
-                free((void *)device->Context.Bistate.Identifier2);
-                free((void *)device->Context.Bistate.Emoji2);
-                device->Context.Bistate.Identifier1 = strdup(cJSON_GetObjectItem(reqContext, "identifier1")->valuestring);
-                device->Context.Bistate.Emoji1 = strdup(cJSON_GetObjectItem(reqContext, "emoji1")->valuestring);
-                device->Context.Bistate.Identifier2 = strdup(cJSON_GetObjectItem(reqContext, "identifier2")->valuestring);
-                device->Context.Bistate.Emoji2 = strdup(cJSON_GetObjectItem(reqContext, "emoji2")->valuestring);
+                // Bind the request over the current context, so the live state is kept
+                device::Context context = device->Context;
+                device->Kind->Bind(cJSON_GetObjectItem(reqJSON, "context"), &context);
+                device->Kind->Free(&device->Context);
+                device->Kind->Copy(&context, &device->Context);
             }
         }
 
@@ -1141,7 +1681,7 @@ namespace server
     esp_err_t Server::apiDeleteDeviceHandler(httpd_req_t *request)
     {
         // Authenticate request user
-        user::User *reqUser = Instance->checkToken(request);
+        Requester *reqUser = Instance->checkToken(request);
         if (reqUser == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
@@ -1153,7 +1693,6 @@ namespace server
 
         // Get device
         device::Device *device = Instance->device->GetByName(name);
-        free((void *)name);
         if (device == NULL)
         {
             delete reqUser;
@@ -1162,7 +1701,7 @@ namespace server
         }
 
         // Check if the requesting user role includes the device or it is an admin
-        if (!Instance->role->Includes(reqUser->Role, device) && !Instance->user->Belongs(reqUser, &role::System::Admin))
+        if (!reqUser->Allows(device))
         {
             delete device;
             delete reqUser;
@@ -1172,15 +1711,20 @@ namespace server
 
         delete reqUser;
 
+        // Delete the device and everything that references it at once
+        database::WriteBatch batch;
+
         // If device is an actuator delete all device's triggers
-        if (!strcmp(device->Type, device::Types::Actuator))
-            Instance->trigger->DeleteByActuator(device->Name);
+        if (device->Type == device::Types::Actuator)
+            Instance->trigger->DeleteByActuator(device->Name, &batch);
 
         // Remove device from all roles
-        Instance->role->RemoveDeviceFromAllRoles(device->Name);
+        Instance->role->RemoveDeviceFromAllRoles(device->Name, &batch);
 
         // Delete device
-        Instance->device->Delete(device->Name);
+        Instance->device->Delete(device->Name, &batch);
+
+        ESP_ERROR_CHECK(batch.Commit());
 
         // Send response JSON
         cJSON *resJSON = device->JSON();
@@ -1194,7 +1738,7 @@ namespace server
     esp_err_t Server::apiPostDeviceActuateHandler(httpd_req_t *request)
     {
         // Authenticate request user
-        user::User *reqUser = Instance->checkToken(request);
+        Requester *reqUser = Instance->checkToken(request);
         if (reqUser == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
@@ -1206,7 +1750,6 @@ namespace server
 
         // Get actuator
         device::Device *actuator = Instance->device->GetByName(name);
-        free((void *)name);
         if (actuator == NULL)
         {
             delete reqUser;
@@ -1215,7 +1758,7 @@ namespace server
         }
 
         // Check if triggered device is an actuator
-        if (strcmp(actuator->Type, device::Types::Actuator))
+        if (actuator->Type != device::Types::Actuator)
         {
             delete actuator;
             delete reqUser;
@@ -1224,7 +1767,7 @@ namespace server
         }
 
         // Check if the requesting user role includes the actuator or it is an admin
-        if (!Instance->role->Includes(reqUser->Role, actuator) && !Instance->user->Belongs(reqUser, &role::System::Admin))
+        if (!reqUser->Allows(actuator))
         {
             delete actuator;
             delete reqUser;
@@ -1237,9 +1780,9 @@ namespace server
         device::Packet command = device::Packet();
         command.Protocol = actuator->Protocol;
 
-        // Make packet depending on actuator subtype
-        if (!strcmp(actuator->Subtype, device::Subtypes::Button))
-            strcpy(command.Data, actuator->Context.Button.Command);
+        // Make packet depending on actuator kind
+        if (actuator->Kind != NULL && actuator->Kind->Command != NULL)
+            actuator->Kind->Command(&actuator->Context, &command);
 
         // Send command to actuator
         Instance->transmitter->Send(&command);
@@ -1257,51 +1800,114 @@ namespace server
     esp_err_t Server::apiGetTriggersHandler(httpd_req_t *request)
     {
         // Authenticate request user
-        user::User *reqUser = Instance->checkToken(request);
+        Requester *reqUser = Instance->checkToken(request);
         if (reqUser == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
             return ESP_FAIL;
         }
 
-        // Get all triggers
-        uint32_t size;
-        trigger::Trigger *triggers = Instance->trigger->List(&size);
+        // Get pagination query params
+        uint32_t limit;
+        database::Cursor cursor;
+        if (Instance->getPageParams(request, &limit, &cursor) != ESP_OK)
+        {
+            delete reqUser;
+            ESP_ERROR_CHECK(Instance->sendError(request, Errors::InvalidRequest, "Invalid pagination"));
+            return ESP_FAIL;
+        }
+
+        // Answer without reading the triggers when the client already has them
+        uint32_t generation = Instance->trigger->Generation() + Instance->device->DefinitionGeneration() + Instance->role->Generation();
+        char etag[ETAG_SIZE + 1];
+        if (Instance->checkETag(request, reqUser, generation, etag))
+        {
+            delete reqUser;
+            return ESP_OK;
+        }
 
-        // Send response JSON
-        cJSON *resJSON = cJSON_CreateObject();
-        cJSON *triggersJSON = cJSON_AddArrayToObject(resJSON, "triggers");
+        Instance->tagResponse(request, etag);
 
-        // Filter triggers depending if the requesting user role includes the triggered actuator or it is an admin
-        for (int i = 0; i < size; i++)
-            if (Instance->role->Includes(reqUser->Role, triggers[i].Actuator) || Instance->user->Belongs(reqUser, &role::System::Admin))
-                cJSON_AddItemToArray(triggersJSON, triggers[i].JSON());
+        // Or with the response rendered for the same role, unless it changed since
+        const char *role = reqUser->Role;
+        if (Instance->cache->Send(request, role, generation))
+        {
+            delete reqUser;
+            return ESP_OK;
+        }
+
+        typedef struct listArgs
+        {
+            Requester *reqUser;
+            Writer *writer;
+        } listArgs;
+
+        // Stream all triggers or a page of them while they are read
+        Writer writer(request, Instance->arena);
+        writer.Capture();
+        ESP_ERROR_CHECK(writer.Begin(Statuses::_200));
+        writer.Write("{\"triggers\":[");
+
+        listArgs args = {reqUser, &writer};
+        trigger::trigger_list_cb_t list = [](trigger::Trigger *trigger, void *context)
+        {
+            listArgs *args = (listArgs *)context;
+
+            // Filter triggers depending if the requesting user role includes the triggered actuator or it is an admin
+            if (!args->reqUser->Allows(trigger->Actuator))
+                return;
+
+            cJSON *triggerJSON = trigger->JSON();
+            args->writer->Item(triggerJSON);
+            cJSON_Delete(triggerJSON);
+        };
+
+        if (limit > 0)
+            Instance->trigger->List(list, &args, limit, &cursor);
+        else
+            Instance->trigger->List(list, &args);
 
         delete reqUser;
-        delete[] triggers;
 
-        ESP_ERROR_CHECK(Instance->sendJSON(request, resJSON, Statuses::_200));
-        cJSON_Delete(resJSON);
+        writer.Write("]");
+        if (limit > 0)
+            Instance->writeCursor(&writer, &cursor);
+        writer.Write("}");
 
-        return ESP_OK;
+        esp_err_t err = writer.End();
+
+        // Keep the response for the next requests that would render the same
+        size_t size;
+        const char *body = writer.Captured(&size);
+        if (body != NULL)
+            Instance->cache->Put(request->uri, role, generation, body, size);
+
+        return err;
     }
 
     esp_err_t Server::apiGetTriggerHandler(httpd_req_t *request)
     {
         // Authenticate request user
-        user::User *reqUser = Instance->checkToken(request);
+        Requester *reqUser = Instance->checkToken(request);
         if (reqUser == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
             return ESP_FAIL;
         }
 
+        // Answer without reading the trigger when the client already has it
+        char etag[ETAG_SIZE + 1];
+        if (Instance->checkETag(request, reqUser, Instance->trigger->Generation() + Instance->device->DefinitionGeneration() + Instance->role->Generation(), etag))
+        {
+            delete reqUser;
+            return ESP_OK;
+        }
+
         // Get name path param
         const char *name = Instance->getPathParam(request);
 
         // Get trigger
         trigger::Trigger *trigger = Instance->trigger->Get(name);
-        free((void *)name);
         if (trigger == NULL)
         {
             delete reqUser;
@@ -1310,7 +1916,7 @@ namespace server
         }
 
         // Check if the requesting user role includes the triggered actuator or it is an admin
-        if (!Instance->role->Includes(reqUser->Role, trigger->Actuator) && !Instance->user->Belongs(reqUser, &role::System::Admin))
+        if (!reqUser->Allows(trigger->Actuator))
         {
             delete trigger;
             delete reqUser;
@@ -1323,6 +1929,7 @@ namespace server
         // Send response JSON
         cJSON *resJSON = trigger->JSON();
         delete trigger;
+        Instance->tagResponse(request, etag);
         ESP_ERROR_CHECK(Instance->sendJSON(request, resJSON, Statuses::_200));
         cJSON_Delete(resJSON);
 
@@ -1332,7 +1939,7 @@ namespace server
     esp_err_t Server::apiPostTriggersHandler(httpd_req_t *request)
     {
         // Authenticate request user
-        user::User *reqUser = Instance->checkToken(request);
+        Requester *reqUser = Instance->checkToken(request);
         if (reqUser == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
@@ -1365,7 +1972,7 @@ namespace server
         }
 
         // Check if triggered device is an actuator
-        if (strcmp(actuator->Type, device::Types::Actuator))
+        if (actuator->Type != device::Types::Actuator)
         {
             delete actuator;
             cJSON_Delete(reqJSON);
@@ -1375,7 +1982,7 @@ namespace server
         }
 
         // Check if the requesting user role includes the actuator or it is an admin
-        if (!Instance->role->Includes(reqUser->Role, actuator) && !Instance->user->Belongs(reqUser, &role::System::Admin))
+        if (!reqUser->Allows(actuator))
         {
             delete actuator;
             cJSON_Delete(reqJSON);
@@ -1420,7 +2027,7 @@ namespace server
     esp_err_t Server::apiPutTriggerHandler(httpd_req_t *request)
     {
         // Authenticate request user
-        user::User *reqUser = Instance->checkToken(request);
+        Requester *reqUser = Instance->checkToken(request);
         if (reqUser == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
@@ -1432,7 +2039,6 @@ namespace server
 
         // Get trigger
         trigger::Trigger *trigger = Instance->trigger->Get(name);
-        free((void *)name);
         if (trigger == NULL)
         {
             delete reqUser;
@@ -1441,7 +2047,7 @@ namespace server
         }
 
         // Check if the requesting user role includes the triggered actuator or it is an admin
-        if (!Instance->role->Includes(reqUser->Role, trigger->Actuator) && !Instance->user->Belongs(reqUser, &role::System::Admin))
+        if (!reqUser->Allows(trigger->Actuator))
         {
             delete trigger;
             delete reqUser;
@@ -1468,7 +2074,7 @@ namespace server
             }
 
             // Check if triggered device is an actuator
-            if (strcmp(actuator->Type, device::Types::Actuator))
+            if (actuator->Type != device::Types::Actuator)
             {
                 delete actuator;
                 cJSON_Delete(reqJSON);
@@ -1479,7 +2085,7 @@ namespace server
             }
 
             // Check if the requesting user role includes the actuator or it is an admin
-            if (!Instance->role->Includes(reqUser->Role, actuator) && !Instance->user->Belongs(reqUser, &role::System::Admin))
+            if (!reqUser->Allows(actuator))
             {
                 delete actuator;
                 cJSON_Delete(reqJSON);
@@ -1536,7 +2142,7 @@ namespace server
     esp_err_t Server::apiDeleteTriggerHandler(httpd_req_t *request)
     {
         // Authenticate request user
-        user::User *reqUser = Instance->checkToken(request);
+        Requester *reqUser = Instance->checkToken(request);
         if (reqUser == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
@@ -1548,7 +2154,6 @@ namespace server
 
         // Get trigger
         trigger::Trigger *trigger = Instance->trigger->Get(name);
-        free((void *)name);
         if (trigger == NULL)
         {
             delete reqUser;
@@ -1557,7 +2162,7 @@ namespace server
         }
 
         // Check if the requesting user role includes the triggered actuator or it is an admin
-        if (!Instance->role->Includes(reqUser->Role, trigger->Actuator) && !Instance->user->Belongs(reqUser, &role::System::Admin))
+        if (!reqUser->Allows(trigger->Actuator))
         {
             delete trigger;
             delete reqUser;
@@ -1582,28 +2187,51 @@ namespace server
     esp_err_t Server::apiGetRolesHandler(httpd_req_t *request)
     {
         // Authenticate request user
-        user::User *reqUser = Instance->checkToken(request);
+        Requester *reqUser = Instance->checkToken(request);
         if (reqUser == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
             return ESP_FAIL;
         }
 
+        // Get pagination query params
+        uint32_t limit;
+        database::Cursor cursor;
+        if (Instance->getPageParams(request, &limit, &cursor) != ESP_OK)
+        {
+            delete reqUser;
+            ESP_ERROR_CHECK(Instance->sendError(request, Errors::InvalidRequest, "Invalid pagination"));
+            return ESP_FAIL;
+        }
+
+        // Answer without reading the roles when the client already has them
+        char etag[ETAG_SIZE + 1];
+        if (Instance->checkETag(request, reqUser, Instance->role->Generation(), etag))
+        {
+            delete reqUser;
+            return ESP_OK;
+        }
+
+        Instance->tagResponse(request, etag);
+
         delete reqUser;
 
-        // Get all roles
-        uint32_t size;
-        role::Role *roles = Instance->role->List(&size);
+        // Get all roles or a page of them
+        database::ResultSet<role::Role> roles;
+        if (limit > 0)
+            Instance->role->List(&roles, limit, &cursor);
+        else
+            Instance->role->List(&roles);
 
         // Send response JSON
         cJSON *resJSON = cJSON_CreateObject();
         cJSON *rolesJSON = cJSON_AddArrayToObject(resJSON, "roles");
+        if (limit > 0)
+            Instance->addCursor(resJSON, &cursor);
 
-        for (int i = 0; i < size; i++)
+        for (int i = 0; i < roles.Size(); i++)
             cJSON_AddItemToArray(rolesJSON, roles[i].JSON());
 
-        delete[] roles;
-
         ESP_ERROR_CHECK(Instance->sendJSON(request, resJSON, Statuses::_200));
         cJSON_Delete(resJSON);
 
@@ -1613,13 +2241,21 @@ namespace server
     esp_err_t Server::apiGetRoleHandler(httpd_req_t *request)
     {
         // Authenticate request user
-        user::User *reqUser = Instance->checkToken(request);
+        Requester *reqUser = Instance->checkToken(request);
         if (reqUser == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
             return ESP_FAIL;
         }
 
+        // Answer without reading the role when the client already has it
+        char etag[ETAG_SIZE + 1];
+        if (Instance->checkETag(request, reqUser, Instance->role->Generation(), etag))
+        {
+            delete reqUser;
+            return ESP_OK;
+        }
+
         delete reqUser;
 
         // Get name path param
@@ -1627,7 +2263,6 @@ namespace server
 
         // Get role
         role::Role *role = Instance->role->Get(name);
-        free((void *)name);
         if (role == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::InvalidRequest, "Role doesn't exist"));
@@ -1637,6 +2272,7 @@ namespace server
         // Send response JSON
         cJSON *resJSON = role->JSON();
         delete role;
+        Instance->tagResponse(request, etag);
         ESP_ERROR_CHECK(Instance->sendJSON(request, resJSON, Statuses::_200));
         cJSON_Delete(resJSON);
 
@@ -1646,7 +2282,7 @@ namespace server
     esp_err_t Server::apiPostRolesHandler(httpd_req_t *request)
     {
         // Authenticate request user
-        user::User *reqUser = Instance->checkToken(request);
+        Requester *reqUser = Instance->checkToken(request);
         if (reqUser == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
@@ -1654,7 +2290,7 @@ namespace server
         }
 
         // Check if the requesting user is an admin
-        if (!Instance->user->Belongs(reqUser, &role::System::Admin))
+        if (!reqUser->Admin)
         {
             delete reqUser;
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::NoPermission, "Cannot create role"));
@@ -1723,7 +2359,7 @@ namespace server
     esp_err_t Server::apiPutRoleHandler(httpd_req_t *request)
     {
         // Authenticate request user
-        user::User *reqUser = Instance->checkToken(request);
+        Requester *reqUser = Instance->checkToken(request);
         if (reqUser == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
@@ -1736,16 +2372,14 @@ namespace server
         // Ensure not modifying the default system roles
         if (role::System::Admin.Equals(name) || role::System::Guest.Equals(name))
         {
-            free((void *)name);
             delete reqUser;
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::NoPermission, "Cannot modify system roles"));
             return ESP_FAIL;
         }
 
         // Check if the requesting user is an admin
-        if (!Instance->user->Belongs(reqUser, &role::System::Admin))
+        if (!reqUser->Admin)
         {
-            free((void *)name);
             delete reqUser;
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::NoPermission, "Cannot modify role"));
             return ESP_FAIL;
@@ -1755,7 +2389,6 @@ namespace server
 
         // Get role
         role::Role *role = Instance->role->Get(name);
-        free((void *)name);
         if (role == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::InvalidRequest, "Role doesn't exist"));
@@ -1823,7 +2456,7 @@ namespace server
     esp_err_t Server::apiDeleteRoleHandler(httpd_req_t *request)
     {
         // Authenticate request user
-        user::User *reqUser = Instance->checkToken(request);
+        Requester *reqUser = Instance->checkToken(request);
         if (reqUser == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
@@ -1836,16 +2469,14 @@ namespace server
         // Ensure not deleting the default system roles
         if (role::System::Admin.Equals(name) || role::System::Guest.Equals(name))
         {
-            free((void *)name);
             delete reqUser;
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::NoPermission, "Cannot delete system roles"));
             return ESP_FAIL;
         }
 
         // Check if the requesting user is an admin
-        if (!Instance->user->Belongs(reqUser, &role::System::Admin))
+        if (!reqUser->Admin)
         {
-            free((void *)name);
             delete reqUser;
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::NoPermission, "Cannot delete role"));
             return ESP_FAIL;
@@ -1855,7 +2486,6 @@ namespace server
 
         // Get role
         role::Role *role = Instance->role->Get(name);
-        free((void *)name);
         if (role == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::InvalidRequest, "Role doesn't exist"));
@@ -1884,7 +2514,7 @@ namespace server
     esp_err_t Server::apiGetSystemInfoHandler(httpd_req_t *request)
     {
         // Authenticate request user
-        user::User *reqUser = Instance->checkToken(request);
+        Requester *reqUser = Instance->checkToken(request);
         if (reqUser == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
@@ -2020,6 +2650,19 @@ namespace server
         cJSON_AddStringToObject(timeJSON, "server", chron::NTP_SERVER_ADDRESS);
         cJSON_AddStringToObject(timeJSON, "zone", chron::TIME_ZONE);
 
+        // Get rendered responses cache info
+        cJSON *serverJSON = cJSON_AddObjectToObject(resJSON, "server");
+        cJSON *serverCacheJSON = cJSON_AddObjectToObject(serverJSON, "cache");
+
+        database::CacheStats serverCacheInfo;
+        Instance->cache->Stats(&serverCacheInfo);
+
+        cJSON_AddNumberToObject(serverCacheJSON, "hits", serverCacheInfo.Hits);
+        cJSON_AddNumberToObject(serverCacheJSON, "misses", serverCacheInfo.Misses);
+        cJSON_AddNumberToObject(serverCacheJSON, "entries", serverCacheInfo.Entries);
+        cJSON_AddNumberToObject(serverCacheJSON, "size", serverCacheInfo.Size);
+        cJSON_AddNumberToObject(serverCacheJSON, "budget", serverCacheInfo.Budget);
+
         // Get database info
         cJSON *databaseJSON = cJSON_AddObjectToObject(resJSON, "database");
 
@@ -2029,6 +2672,65 @@ namespace server
         cJSON_AddNumberToObject(databaseJSON, "total", databaseInfo.total_entries);
         cJSON_AddNumberToObject(databaseJSON, "used", databaseInfo.used_entries);
 
+        // Get database cache info, note that opening a namespace returns its already opened handle
+        cJSON *cacheJSON = cJSON_AddObjectToObject(databaseJSON, "cache");
+
+        const char *cachedNamespaces[] = {user::DB_NAMESPACE, device::DB_NAMESPACE, role::DB_NAMESPACE};
+        for (int i = 0; i < sizeof(cachedNamespaces) / sizeof(char *); i++)
+        {
+            database::CacheStats cacheInfo;
+            Instance->database->Open(cachedNamespaces[i])->GetCacheStats(&cacheInfo);
+
+            cJSON *namespaceJSON = cJSON_AddObjectToObject(cacheJSON, cachedNamespaces[i]);
+            cJSON_AddNumberToObject(namespaceJSON, "hits", cacheInfo.Hits);
+            cJSON_AddNumberToObject(namespaceJSON, "misses", cacheInfo.Misses);
+            cJSON_AddNumberToObject(namespaceJSON, "entries", cacheInfo.Entries);
+            cJSON_AddNumberToObject(namespaceJSON, "size", cacheInfo.Size);
+            cJSON_AddNumberToObject(namespaceJSON, "budget", cacheInfo.Budget);
+        }
+
+        // Get database string pool info
+        cJSON *poolJSON = cJSON_AddObjectToObject(databaseJSON, "pool");
+
+        database::PoolStats poolInfo;
+        database::Pool::Stats(&poolInfo);
+
+        cJSON_AddNumberToObject(poolJSON, "strings", poolInfo.Strings);
+        cJSON_AddNumberToObject(poolJSON, "size", poolInfo.Size);
+
+#if CONFIG_DATABASE_PROFILE
+        // Get database operation latencies, in microseconds, and footprint per namespace
+        cJSON *profileJSON = cJSON_AddObjectToObject(databaseJSON, "profile");
+
+        const char *operationNames[database::OPERATION_MAX] = {"get", "set", "delete", "count", "find", "scan"};
+        const char *profiledNamespaces[] = {user::DB_NAMESPACE, device::DB_NAMESPACE, device::DB_STATE_NAMESPACE,
+                                            role::DB_NAMESPACE, trigger::DB_NAMESPACE};
+        for (int i = 0; i < sizeof(profiledNamespaces) / sizeof(char *); i++)
+        {
+            database::HandleStats handleInfo;
+            Instance->database->Open(profiledNamespaces[i])->GetStats(&handleInfo);
+
+            cJSON *namespaceJSON = cJSON_AddObjectToObject(profileJSON, profiledNamespaces[i]);
+            cJSON_AddNumberToObject(namespaceJSON, "records", handleInfo.Records);
+            cJSON_AddNumberToObject(namespaceJSON, "entries", handleInfo.Entries);
+
+            for (int j = 0; j < database::OPERATION_MAX; j++)
+            {
+                const database::OperationStats *operationInfo = &handleInfo.Operations[j];
+
+                cJSON *operationJSON = cJSON_AddObjectToObject(namespaceJSON, operationNames[j]);
+                cJSON_AddNumberToObject(operationJSON, "calls", operationInfo->Calls);
+                cJSON_AddNumberToObject(operationJSON, "errors", operationInfo->Errors);
+                cJSON_AddNumberToObject(operationJSON, "mean", operationInfo->Calls > 0 ? operationInfo->Total / operationInfo->Calls : 0);
+                cJSON_AddNumberToObject(operationJSON, "p50", operationInfo->Percentile(50));
+                cJSON_AddNumberToObject(operationJSON, "p90", operationInfo->Percentile(90));
+                cJSON_AddNumberToObject(operationJSON, "p99", operationInfo->Percentile(99));
+                cJSON_AddNumberToObject(operationJSON, "max", operationInfo->Max);
+                cJSON_AddNumberToObject(operationJSON, "allocations", operationInfo->Calls > 0 ? operationInfo->Allocations / operationInfo->Calls : 0);
+            }
+        }
+#endif
+
         // Send response JSON
         ESP_ERROR_CHECK(Instance->sendJSON(request, resJSON, Statuses::_200));
         cJSON_Delete(resJSON);
@@ -2039,7 +2741,7 @@ namespace server
     esp_err_t Server::apiGetSystemTimeHandler(httpd_req_t *request)
     {
         // Authenticate request user
-        user::User *reqUser = Instance->checkToken(request);
+        Requester *reqUser = Instance->checkToken(request);
         if (reqUser == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
@@ -2064,7 +2766,7 @@ namespace server
     esp_err_t Server::apiGetSystemWifiHandler(httpd_req_t *request)
     {
         // Authenticate request user
-        user::User *reqUser = Instance->checkToken(request);
+        Requester *reqUser = Instance->checkToken(request);
         if (reqUser == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
@@ -2230,7 +2932,7 @@ namespace server
     esp_err_t Server::apiPutSystemWifiHandler(httpd_req_t *request)
     {
         // Authenticate request user
-        user::User *reqUser = Instance->checkToken(request);
+        Requester *reqUser = Instance->checkToken(request);
         if (reqUser == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
@@ -2238,7 +2940,7 @@ namespace server
         }
 
         // Check if the requesting user is an admin
-        if (!Instance->user->Belongs(reqUser, &role::System::Admin))
+        if (!reqUser->Admin)
         {
             delete reqUser;
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::NoPermission, "Cannot change system wifi"));
@@ -2280,7 +2982,7 @@ namespace server
     esp_err_t Server::apiDeleteSystemResetHandler(httpd_req_t *request)
     {
         // Authenticate request user
-        user::User *reqUser = Instance->checkToken(request);
+        Requester *reqUser = Instance->checkToken(request);
         if (reqUser == NULL)
         {
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::Unauthorized, NULL));
@@ -2288,7 +2990,7 @@ namespace server
         }
 
         // Check if the requesting user is an admin
-        if (!Instance->user->Belongs(reqUser, &role::System::Admin))
+        if (!reqUser->Admin)
         {
             delete reqUser;
             ESP_ERROR_CHECK(Instance->sendError(request, Errors::NoPermission, "Cannot reset system"));
@@ -4,6 +4,7 @@
 #include "esp_http_server.h"
 #include "http_parser.h"
 #include "esp_vfs_fat.h"
+#include "esp_partition.h"
 #include "cJSON.h"
 #include "logger.hpp"
 #include "database.hpp"
@@ -18,7 +19,7 @@ namespace server
 {
     static const char *TAG = "server";
 
-    static const char *PARTITION = "static";
+    static const char *PARTITION = "static"; // Holding the raw frontend bundle, or a FAT filesystem with it
     static const char *ROOT = "/static";
     static const char *FRONTEND = "/static/frontend.gz";
 
@@ -26,6 +27,13 @@ namespace server
     static const uint16_t MAX_CLIENTS = 5;
     static const uint32_t MAX_REQUEST_HEADER_SIZE = 128;
     static const uint32_t MAX_REQUEST_CONTENT_SIZE = 1024;
+    static const uint32_t MAX_REQUEST_QUERY_SIZE = 64;
+    static const uint32_t MAX_PAGE_LIMIT = 50;
+    static const uint32_t RESPONSE_BUFFER_SIZE = 512; // Initial, doubled until the response fits
+    static const uint32_t WRITER_BUFFER_SIZE = 512;   // Flushed as a chunk whenever it fills
+    static const uint32_t ETAG_SIZE = 3 * 8 + 2;      // Quoted boot, role and generation in hex
+    static const uint32_t CACHE_SIZE = 16 * 1024;     // Bytes
+    static const uint32_t MAX_CACHED_SIZE = 4 * 1024; // Bytes, larger responses are not cached
 
     namespace Methods
     {
@@ -41,6 +49,7 @@ namespace server
         static const char *_204 = "204 No Content";
         static const char *_301 = "301 Moved Permanently";
         static const char *_302 = "302 Temporary Redirect";
+        static const char *_304 = "304 Not Modified";
         static const char *_400 = "400 Bad Request";
         static const char *_401 = "401 Unauthorized";
         static const char *_403 = "403 Forbidden";
@@ -67,6 +76,8 @@ namespace server
         static const char *ContentEncoding = "Content-Encoding";
         static const char *Connection = "Connection";
         static const char *Authorization = "Authorization";
+        static const char *ETag = "ETag";
+        static const char *IfNoneMatch = "If-None-Match";
     }
 
     class Error
@@ -85,6 +96,95 @@ namespace server
         static const Error ServerGeneric = {"ERR_SERVER_GENERIC", Statuses::_500};
     }
 
+    // JSON response sent in chunks while it is written, so its memory does not grow with its length.
+    // Items are separated by commas until raw text is written, which the caller uses to open and close arrays.
+    class Writer
+    {
+    private:
+        httpd_req_t *request;
+        database::Arena *arena;
+        char *buffer;
+        size_t size;     // Bytes written to the buffer
+        bool separated;  // Whether the next item follows another one
+        esp_err_t err;   // First failure, after which nothing else is sent
+        char *capture;   // Copy of everything sent, NULL unless captured or once it does not fit
+        size_t captured; // Bytes
+
+    private:
+        void send(const char *data, size_t size);
+        void flush();
+        bool print(cJSON *item);
+
+    public:
+        Writer(httpd_req_t *request, database::Arena *arena);
+
+    public:
+        esp_err_t Begin(const char *status);
+        void Write(const char *str);
+        void Item(cJSON *item);
+        esp_err_t End();
+        void Capture(); // Keep a copy of the response, up to MAX_CACHED_SIZE
+        const char *Captured(size_t *size) const; // NULL if the response was not fully captured or sent
+    };
+
+    // Least recently used cache of rendered responses bounded by a byte budget. Responses are keyed by URI
+    // and the role they were filtered for, and are only kept while the generation of their path holds.
+    // It is only used by the server task, which handles one request at a time, so it is not locked.
+    class Cache
+    {
+    private:
+        class Entry
+        {
+        public:
+            char *URI;
+            const char *Role; // Interned, NULL if the response is the same for every role
+            uint32_t Generation;
+            char *Body;
+            uint32_t Length; // Bytes of the body
+            uint32_t Size;   // Bytes
+            Entry *Prev;
+            Entry *Next;
+        };
+
+        Entry *head; // Most recently used
+        Entry *tail; // Least recently used
+        uint32_t budget;
+        uint32_t size;
+        uint32_t entries;
+        uint32_t hits;
+        uint32_t misses;
+
+    private:
+        Entry *find(const char *uri, const char *role);
+        void link(Entry *entry);
+        void unlink(Entry *entry);
+        void remove(Entry *entry);
+
+    public:
+        static Cache *New(uint32_t budget);
+
+    public:
+        bool Send(httpd_req_t *request, const char *role, uint32_t generation);
+        void Put(const char *uri, const char *role, uint32_t generation, const char *body, uint32_t length);
+        void Stats(database::CacheStats *stats);
+    };
+
+    // Authenticated user of a request, with its authorization resolved once so handlers do not read roles
+    class Requester
+    {
+    public:
+        const char *Name;
+        const char *Role; // Interned
+        bool Admin;
+        device::Slots Devices; // Included in the role
+
+    public:
+        Requester();
+        ~Requester();
+        bool Allows(device::Device *device) const;
+        bool Allows(const char *device) const;
+    };
+
     class Server
     {
     private:
@@ -100,6 +200,14 @@ namespace server
         role::Controller *role;
         httpd_handle_t espServer;
         wl_handle_t fsHandle;
+        const char *frontend; // Mapped from its raw partition, NULL when read from FATFS
+        bool frontendMissing; // Raw partition without a gzipped bundle
+        size_t frontendSize;
+        esp_partition_mmap_handle_t frontendHandle;
+        char frontendETag[ETAG_SIZE + 1]; // From the content, so it holds across builds and reboots
+        database::Arena *arena; // Of the request being handled, reset when it ends
+        uint32_t boot;          // Random, so tags from before a reboot never match
+        Cache *cache;           // Of list responses
         httpd_uri_t frontURIHandler = {"/?*", Methods::GET, frontHandler};
 
         httpd_uri_t apiPostRegisterURIHandler = {"/api/register", Methods::POST, apiPostRegisterHandler};
@@ -139,12 +247,22 @@ namespace server
     private:
         void start();
         void stop();
+        esp_err_t registerHandler(httpd_uri_t *uri);
+        static esp_err_t requestHandler(httpd_req_t *request);
         esp_err_t sendFile(httpd_req_t *request, const char *path, const char *status);
+        void mapFrontend(const esp_partition_t *partition);
+        esp_err_t sendFrontend(httpd_req_t *request);
         esp_err_t sendJSON(httpd_req_t *request, cJSON *json, const char *status);
         esp_err_t sendError(httpd_req_t *request, Error error, const char *message);
         esp_err_t recvJSON(httpd_req_t *request, cJSON **json);
-        user::User *checkToken(httpd_req_t *request);
+        Requester *checkToken(httpd_req_t *request);
         const char *getPathParam(httpd_req_t *request);
+        esp_err_t getPageParams(httpd_req_t *request, uint32_t *limit, database::Cursor *cursor);
+        void addCursor(cJSON *json, database::Cursor *cursor);
+        void writeCursor(Writer *writer, database::Cursor *cursor);
+        bool matchETag(httpd_req_t *request, const char *etag);
+        bool checkETag(httpd_req_t *request, Requester *reqUser, uint32_t generation, char etag[ETAG_SIZE + 1]);
+        void tagResponse(httpd_req_t *request, const char *etag);
         static void apFunc(void *args, esp_event_base_t base, int32_t id, void *data);
         static void staFunc(void *args, esp_event_base_t base, int32_t id, void *data);
         static void ipFunc(void *args, esp_event_base_t base, int32_t id, void *data);
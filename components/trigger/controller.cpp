@@ -29,27 +29,42 @@ namespace trigger
         this->Actuator = strdup(actuator);
         this->Schedule = strdup(schedule);
         this->Emoji = strdup(emoji);
-        this->Creator = strdup(creator);
+        this->Creator = database::Pool::Intern(creator);
         this->CreatedAt = createdAt;
     }
 
-    Trigger::Trigger(cJSON *src)
+    Trigger::Trigger(cJSON *src, database::Arena *arena)
     {
-        this->Name = strdup(cJSON_GetObjectItem(src, "name")->valuestring);
-        this->Actuator = strdup(cJSON_GetObjectItem(src, "actuator")->valuestring);
-        this->Schedule = strdup(cJSON_GetObjectItem(src, "schedule")->valuestring);
-        this->Emoji = strdup(cJSON_GetObjectItem(src, "emoji")->valuestring);
-        this->Creator = strdup(cJSON_GetObjectItem(src, "creator")->valuestring);
+        this->Name = database::Arena::Copy(arena, cJSON_GetObjectItem(src, "name"));
+        this->Actuator = database::Arena::Copy(arena, cJSON_GetObjectItem(src, "actuator"));
+        this->Schedule = database::Arena::Copy(arena, cJSON_GetObjectItem(src, "schedule"));
+        this->Emoji = database::Arena::Copy(arena, cJSON_GetObjectItem(src, "emoji"));
+        this->Creator = database::Pool::Intern(cJSON_GetObjectItem(src, "creator")->valuestring);
         this->CreatedAt = cJSON_GetObjectItem(src, "created_at")->valueint;
     }
 
+    Trigger::Trigger(Trigger &&other)
+    {
+        // Take over the strings of other, which is left empty
+        this->Name = other.Name;
+        this->Actuator = other.Actuator;
+        this->Schedule = other.Schedule;
+        this->Emoji = other.Emoji;
+        this->Creator = other.Creator;
+        this->CreatedAt = other.CreatedAt;
+
+        other.Name = NULL;
+        other.Actuator = NULL;
+        other.Schedule = NULL;
+        other.Emoji = NULL;
+    }
+
     Trigger::~Trigger()
     {
         free((void *)this->Name);
         free((void *)this->Actuator);
         free((void *)this->Schedule);
         free((void *)this->Emoji);
-        free((void *)this->Creator);
     }
 
     Trigger &Trigger::operator=(const Trigger &other)
@@ -61,18 +76,42 @@ namespace trigger
         free((void *)this->Actuator);
         free((void *)this->Schedule);
         free((void *)this->Emoji);
-        free((void *)this->Creator);
 
         this->Name = strdup(other.Name);
         this->Actuator = strdup(other.Actuator);
         this->Schedule = strdup(other.Schedule);
         this->Emoji = strdup(other.Emoji);
-        this->Creator = strdup(other.Creator);
+        this->Creator = other.Creator;
         this->CreatedAt = other.CreatedAt;
 
         return *this;
     }
 
+    Trigger &Trigger::operator=(Trigger &&other)
+    {
+        if (this == &other)
+            return *this;
+
+        free((void *)this->Name);
+        free((void *)this->Actuator);
+        free((void *)this->Schedule);
+        free((void *)this->Emoji);
+
+        this->Name = other.Name;
+        this->Actuator = other.Actuator;
+        this->Schedule = other.Schedule;
+        this->Emoji = other.Emoji;
+        this->Creator = other.Creator;
+        this->CreatedAt = other.CreatedAt;
+
+        other.Name = NULL;
+        other.Actuator = NULL;
+        other.Schedule = NULL;
+        other.Emoji = NULL;
+
+        return *this;
+    }
+
     cJSON *Trigger::JSON()
     {
         cJSON *root = cJSON_CreateObject();
@@ -116,6 +155,14 @@ namespace trigger
         Instance->transmitter = transmitter;
         Instance->device = device;
         Instance->db = database->Open(DB_NAMESPACE);
+        Instance->db->SetSchema(&DB_SCHEMA);
+        ESP_ERROR_CHECK(Instance->db->AddIndex(
+            DB_INDEX_ACTUATOR,
+            [](cJSON *value, const char *terms[database::INDEX_MAX_TERMS]) -> uint8_t
+            {
+                terms[0] = cJSON_GetObjectItem(value, "actuator")->valuestring;
+                return 1;
+            }));
 
         // Create trigger scheduler task
         xTaskCreatePinnedToCore(Instance->taskFunc, "Trigger", 4 * 1024, NULL, 7, &Instance->taskHandle, tskNO_AFFINITY);
@@ -143,11 +190,11 @@ namespace trigger
             now = Instance->chron->Now();
 
             // Get all triggers
-            uint32_t size;
-            Trigger *triggers = Instance->List(&size);
+            database::ResultSet<Trigger> triggers;
+            Instance->List(&triggers);
 
             // Test schedule of all triggers
-            for (int i = 0; i < size; i++)
+            for (int i = 0; i < triggers.Size(); i++)
             {
                 memset(&schedule, 0, sizeof(cron_expr));
                 err = NULL;
@@ -178,9 +225,9 @@ namespace trigger
                     device::Packet command = device::Packet();
                     command.Protocol = actuator->Protocol;
 
-                    // Make packet depending on actuator subtype
-                    if (!strcmp(actuator->Subtype, device::Subtypes::Button))
-                        strcpy(command.Data, actuator->Context.Button.Command);
+                    // Make packet depending on actuator kind
+                    if (actuator->Kind != NULL && actuator->Kind->Command != NULL)
+                        actuator->Kind->Command(&actuator->Context, &command);
 
                     // Send command to actuator
                     Instance->transmitter->Send(&command);
@@ -191,8 +238,6 @@ namespace trigger
                 }
             }
 
-            delete[] triggers;
-
             vTaskDelay(SCHEDULER_PERIOD);
         }
     }
@@ -206,6 +251,11 @@ namespace trigger
         return count;
     }
 
+    uint32_t Controller::Generation()
+    {
+        return this->db->Generation();
+    }
+
     Trigger *Controller::Get(const char *name)
     {
         Trigger *trigger = NULL;
@@ -221,33 +271,79 @@ namespace trigger
         return trigger;
     }
 
-    Trigger *Controller::List(uint32_t *size)
+    void Controller::List(database::ResultSet<Trigger> *triggers)
     {
-        uint32_t count = this->Count();
-        *size = count;
-        if (count < 1)
-            return NULL;
+        // Size the result set for the current records, ones added meanwhile just grow it
+        triggers->Reserve(this->Count());
+
+        ESP_ERROR_CHECK(this->db->Scan(
+            [](const char *key, cJSON *triggerJSON, void *context) -> bool
+            {
+                ((database::ResultSet<Trigger> *)context)->Add(triggerJSON);
+                return false;
+            },
+            triggers));
+    }
 
-        Trigger *list = new Trigger[count];
-        Trigger *aux = list;
+    void Controller::List(database::ResultSet<Trigger> *triggers, uint32_t limit, database::Cursor *cursor)
+    {
+        // Pages are bounded, so they are allocated upfront
+        triggers->Reserve(limit);
 
-        ESP_ERROR_CHECK(this->db->Find(
-            [](const char *key, void *context) -> bool
+        ESP_ERROR_CHECK(this->db->Scan(
+            [](const char *key, cJSON *triggerJSON, void *context) -> bool
             {
-                Trigger *list = *(Trigger **)context;
+                ((database::ResultSet<Trigger> *)context)->Add(triggerJSON);
+                return false;
+            },
+            triggers, limit, cursor));
+    }
 
-                cJSON *triggerJSON = NULL;
-                ESP_ERROR_CHECK(Instance->db->Get(key, &triggerJSON));
+    typedef struct listArgs
+    {
+        trigger_list_cb_t list;
+        void *context;
+        database::Arena *arena;
+    } listArgs;
 
-                *list = Trigger(triggerJSON);
-                (*(Trigger **)context)++;
+    void Controller::List(trigger_list_cb_t list, void *context)
+    {
+        // Triggers are built one at a time, reusing the same arena
+        database::Arena arena;
+        listArgs args = {list, context, &arena};
+
+        ESP_ERROR_CHECK(this->db->Scan(
+            [](const char *key, cJSON *triggerJSON, void *context) -> bool
+            {
+                listArgs *args = (listArgs *)context;
+
+                Trigger *trigger = new (args->arena->Allocate(sizeof(Trigger))) Trigger(triggerJSON, args->arena);
+                args->list(trigger, args->context);
+                args->arena->Reset();
 
-                cJSON_Delete(triggerJSON);
                 return false;
             },
-            &aux));
+            &args));
+    }
 
-        return list;
+    void Controller::List(trigger_list_cb_t list, void *context, uint32_t limit, database::Cursor *cursor)
+    {
+        // Triggers are built one at a time, reusing the same arena
+        database::Arena arena;
+        listArgs args = {list, context, &arena};
+
+        ESP_ERROR_CHECK(this->db->Scan(
+            [](const char *key, cJSON *triggerJSON, void *context) -> bool
+            {
+                listArgs *args = (listArgs *)context;
+
+                Trigger *trigger = new (args->arena->Allocate(sizeof(Trigger))) Trigger(triggerJSON, args->arena);
+                args->list(trigger, args->context);
+                args->arena->Reset();
+
+                return false;
+            },
+            &args, limit, cursor));
     }
 
     void Controller::Set(Trigger *trigger)
@@ -262,18 +358,37 @@ namespace trigger
         ESP_ERROR_CHECK(this->db->Delete(name));
     }
 
-    void Controller::DeleteByActuator(const char *actuator)
+    void Controller::DeleteByActuator(const char *actuator, database::WriteBatch *batch)
     {
-        // Get all triggers, notice that deleting an NVS entry while iterating is not possible
-        uint32_t size;
-        Trigger *triggers = this->List(&size);
+        typedef struct deleteArgs
+        {
+            const char *actuator;
+            database::WriteBatch *batch;
+        } deleteArgs;
+
+        deleteArgs args = {
+            .actuator = actuator,
+            .batch = batch,
+        };
+
+        // Only the triggers of the actuator are read
+        ESP_ERROR_CHECK(this->db->Lookup(
+            DB_INDEX_ACTUATOR, actuator,
+            [](const char *key, void *funcArgs) -> bool
+            {
+                deleteArgs *args = (deleteArgs *)funcArgs;
+
+                cJSON *triggerJSON = NULL;
+                ESP_ERROR_CHECK(Instance->db->Get(key, &triggerJSON));
 
-        // Delete triggers by actuator
-        for (int i = 0; i < size; i++)
-            if (!strcmp(triggers[i].Actuator, actuator))
-                ESP_ERROR_CHECK(this->db->Delete(triggers[i].Name));
+                // Index matches can be stale, verify them against the record
+                if (triggerJSON != NULL && !strcmp(cJSON_GetObjectItem(triggerJSON, "actuator")->valuestring, args->actuator))
+                    args->batch->Delete(Instance->db, key); // Committed along with the rest of the batch
 
-        delete[] triggers;
+                cJSON_Delete(triggerJSON);
+                return false;
+            },
+            &args));
     }
 
     void Controller::Drop()
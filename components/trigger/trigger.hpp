@@ -13,6 +13,17 @@ namespace trigger
     static const char *TAG = "trigger";
 
     static const char *DB_NAMESPACE = "trigger";
+    static const char *DB_INDEX_ACTUATOR = "trigger_actu"; // Actuator name -> trigger names
+    static const database::Field DB_FIELDS[] = {
+        {"name", database::FIELD_STRING},
+        {"actuator", database::FIELD_STRING},
+        {"schedule", database::FIELD_STRING},
+        {"emoji", database::FIELD_STRING},
+        {"creator", database::FIELD_STRING},
+        {"created_at", database::FIELD_NUMBER},
+    };
+    static const database::Schema DB_SCHEMA = {1, DB_FIELDS, sizeof(DB_FIELDS) / sizeof(database::Field)};
+
     static const TickType_t SCHEDULER_PERIOD = (1 * 60 * 1000) / portTICK_PERIOD_MS; // 1 minute
 
     class Trigger
@@ -22,22 +33,27 @@ namespace trigger
         const char *Actuator;
         const char *Schedule;
         const char *Emoji;
-        const char *Creator;
+        const char *Creator; // Interned
         time_t CreatedAt;
 
     public:
         Trigger();
         Trigger(const char *name, const char *actuator, const char *schedule,
                 const char *emoji, const char *creator, time_t createdAt);
-        Trigger(cJSON *src);
+        Trigger(cJSON *src, database::Arena *arena = NULL); // Strings are copied from src, to the arena when given
+        Trigger(Trigger &&other);
         ~Trigger();
         Trigger &operator=(const Trigger &other);
+        Trigger &operator=(Trigger &&other);
         cJSON *JSON();
         bool Equals(const char *name) const;
         bool Equals(Trigger *other) const;
         bool Equals(const Trigger *other) const;
     };
 
+    // Receives each listed trigger, which is only valid during the call
+    typedef void (*trigger_list_cb_t)(Trigger *trigger, void *context);
+
     class Controller
     {
     private:
@@ -59,11 +75,15 @@ namespace trigger
 
     public:
         uint32_t Count();
+        uint32_t Generation(); // Bumped whenever the records change
         Trigger *Get(const char *name);
-        Trigger *List(uint32_t *size);
+        void List(database::ResultSet<Trigger> *triggers);
+        void List(database::ResultSet<Trigger> *triggers, uint32_t limit, database::Cursor *cursor);
+        void List(trigger_list_cb_t list, void *context);
+        void List(trigger_list_cb_t list, void *context, uint32_t limit, database::Cursor *cursor);
         void Set(Trigger *trigger);
         void DeleteByName(const char *name);
-        void DeleteByActuator(const char *actuator);
+        void DeleteByActuator(const char *actuator, database::WriteBatch *batch);
         void Drop();
         bool IsScheduleValid(const char *schedule);
     };
@@ -1,6 +1,11 @@
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "esp_random.h"
+#include "esp_partition.h"
 #include "sha/sha_block.h"
 #include "cJSON.h"
 #include "logger.hpp"
@@ -18,6 +23,7 @@ namespace user
         this->Role = NULL;
         this->Emoji = NULL;
         this->CreatedAt = 0;
+        this->Generation = 0;
     }
 
     User::User(const char *name, const char *password, const char *token,
@@ -26,19 +32,43 @@ namespace user
         this->Name = strdup(name);
         this->Password = strdup(password);
         this->Token = strdup(token);
-        this->Role = strdup(role);
+        this->Role = database::Pool::Intern(role);
         this->Emoji = strdup(emoji);
         this->CreatedAt = createdAt;
+
+        // Start from a random generation, so tokens of a deleted user with the same name are not valid for this one
+        this->Generation = esp_random();
     }
 
-    User::User(cJSON *src)
+    User::User(cJSON *src, database::Arena *arena)
     {
-        this->Name = strdup(cJSON_GetObjectItem(src, "name")->valuestring);
-        this->Password = strdup(cJSON_GetObjectItem(src, "password")->valuestring);
-        this->Token = strdup(cJSON_GetObjectItem(src, "token")->valuestring);
-        this->Role = strdup(cJSON_GetObjectItem(src, "role")->valuestring);
-        this->Emoji = strdup(cJSON_GetObjectItem(src, "emoji")->valuestring);
+        this->Name = database::Arena::Copy(arena, cJSON_GetObjectItem(src, "name"));
+        this->Password = database::Arena::Copy(arena, cJSON_GetObjectItem(src, "password"));
+        this->Token = database::Arena::Copy(arena, cJSON_GetObjectItem(src, "token"));
+        this->Role = database::Pool::Intern(cJSON_GetObjectItem(src, "role")->valuestring);
+        this->Emoji = database::Arena::Copy(arena, cJSON_GetObjectItem(src, "emoji"));
         this->CreatedAt = cJSON_GetObjectItem(src, "created_at")->valueint;
+
+        // Users stored before signed tokens have none
+        cJSON *generation = cJSON_GetObjectItem(src, "generation");
+        this->Generation = generation != NULL ? generation->valuedouble : 0;
+    }
+
+    User::User(User &&other)
+    {
+        // Take over the strings of other, which is left empty
+        this->Name = other.Name;
+        this->Password = other.Password;
+        this->Token = other.Token;
+        this->Role = other.Role;
+        this->Emoji = other.Emoji;
+        this->CreatedAt = other.CreatedAt;
+        this->Generation = other.Generation;
+
+        other.Name = NULL;
+        other.Password = NULL;
+        other.Token = NULL;
+        other.Emoji = NULL;
     }
 
     User::~User()
@@ -46,7 +76,6 @@ namespace user
         free((void *)this->Name);
         free((void *)this->Password);
         free((void *)this->Token);
-        free((void *)this->Role);
         free((void *)this->Emoji);
     }
 
@@ -58,15 +87,41 @@ namespace user
         free((void *)this->Name);
         free((void *)this->Password);
         free((void *)this->Token);
-        free((void *)this->Role);
         free((void *)this->Emoji);
 
         this->Name = strdup(other.Name);
         this->Password = strdup(other.Password);
         this->Token = strdup(other.Token);
-        this->Role = strdup(other.Role);
+        this->Role = other.Role;
         this->Emoji = strdup(other.Emoji);
         this->CreatedAt = other.CreatedAt;
+        this->Generation = other.Generation;
+
+        return *this;
+    }
+
+    User &User::operator=(User &&other)
+    {
+        if (this == &other)
+            return *this;
+
+        free((void *)this->Name);
+        free((void *)this->Password);
+        free((void *)this->Token);
+        free((void *)this->Emoji);
+
+        this->Name = other.Name;
+        this->Password = other.Password;
+        this->Token = other.Token;
+        this->Role = other.Role;
+        this->Emoji = other.Emoji;
+        this->CreatedAt = other.CreatedAt;
+        this->Generation = other.Generation;
+
+        other.Name = NULL;
+        other.Password = NULL;
+        other.Token = NULL;
+        other.Emoji = NULL;
 
         return *this;
     }
@@ -81,6 +136,7 @@ namespace user
         cJSON_AddStringToObject(root, "role", this->Role);
         cJSON_AddStringToObject(root, "emoji", this->Emoji);
         cJSON_AddNumberToObject(root, "created_at", this->CreatedAt);
+        cJSON_AddNumberToObject(root, "generation", this->Generation);
 
         return root;
     }
@@ -110,6 +166,25 @@ namespace user
         // Inject dependencies
         Instance->logger = logger;
         Instance->db = database->Open(DB_NAMESPACE);
+        Instance->db->SetSchema(&DB_SCHEMA);
+        Instance->db->SetCache(DB_CACHE_SIZE);
+
+        Instance->lock = xSemaphoreCreateMutex();
+        if (!Instance->lock)
+            ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+
+        memset(Instance->sessions, 0, sizeof(Instance->sessions));
+        Instance->loadSecret();
+
+        // Restore the sessions of logged in users
+        ESP_ERROR_CHECK(Instance->db->Scan(
+            [](const char *key, cJSON *userJSON, void *context) -> bool
+            {
+                User user(userJSON);
+                Instance->loadSession(&user);
+                return false;
+            },
+            NULL));
 
         // Create or reset default system user
         Instance->Set((User *)(&System::System));
@@ -117,6 +192,171 @@ namespace user
         return Instance;
     }
 
+    void Controller::digestToken(const char *token, uint8_t digest[TOKEN_DIGEST_SIZE])
+    {
+        esp_sha(SHA2_256, (const unsigned char *)token, strlen(token), digest);
+    }
+
+    void Controller::loadSecret()
+    {
+        const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS_KEYS, SECRET_PARTITION);
+        if (partition == NULL)
+            ESP_ERROR_CHECK(ESP_ERR_NOT_FOUND);
+
+        ESP_ERROR_CHECK(esp_partition_read(partition, SECRET_OFFSET, this->secret, SECRET_SIZE));
+
+        // Erased flash reads as all ones, so the secret is generated on the first boot
+        bool erased = true;
+        for (int i = 0; erased && i < SECRET_SIZE; i++)
+            erased = this->secret[i] == 0xFF;
+
+        if (erased)
+        {
+            esp_fill_random(this->secret, SECRET_SIZE);
+            ESP_ERROR_CHECK(esp_partition_write(partition, SECRET_OFFSET, this->secret, SECRET_SIZE));
+        }
+    }
+
+    void Controller::sign(const char *name, const char *claims, size_t length, char signature[SIGNATURE_SIZE * 2 + 1])
+    {
+        uint8_t buffer[HMAC_BLOCK_SIZE + NVS_KEY_NAME_MAX_SIZE + SIGNED_TOKEN_SIZE];
+        uint8_t hash[SIGNATURE_SIZE];
+
+        // Message is "<name>:<claims>"
+        size_t size = strlen(name);
+        memcpy(buffer + HMAC_BLOCK_SIZE, name, size);
+        buffer[HMAC_BLOCK_SIZE + size++] = ':';
+        memcpy(buffer + HMAC_BLOCK_SIZE + size, claims, length);
+        size += length;
+
+        // HMAC-SHA256 on the SHA accelerator, the secret is shorter than a block so it is only padded
+        for (int i = 0; i < HMAC_BLOCK_SIZE; i++)
+            buffer[i] = (i < SECRET_SIZE ? this->secret[i] : 0) ^ 0x36;
+        esp_sha(SHA2_256, buffer, HMAC_BLOCK_SIZE + size, hash);
+
+        for (int i = 0; i < HMAC_BLOCK_SIZE; i++)
+            buffer[i] = (i < SECRET_SIZE ? this->secret[i] : 0) ^ 0x5C;
+        memcpy(buffer + HMAC_BLOCK_SIZE, hash, SIGNATURE_SIZE);
+        esp_sha(SHA2_256, buffer, HMAC_BLOCK_SIZE + SIGNATURE_SIZE, hash);
+
+        for (int i = 0; i < SIGNATURE_SIZE; i++)
+        {
+            signature[i * 2] = PASSWORD_HASH_CHARSET[(hash[i] >> 4) & 0xF];
+            signature[i * 2 + 1] = PASSWORD_HASH_CHARSET[hash[i] & 0xF];
+        }
+
+        signature[SIGNATURE_SIZE * 2] = '\0';
+    }
+
+    bool Controller::checkToken(Session *session, const char *token)
+    {
+        if (!session->Active)
+            return false;
+
+        uint8_t digest[TOKEN_DIGEST_SIZE];
+        digestToken(token, digest);
+
+        // Compare the whole digest, so the time taken does not tell how much of the token matched
+        uint8_t diff = 0;
+        for (int i = 0; i < TOKEN_DIGEST_SIZE; i++)
+            diff |= session->Digest[i] ^ digest[i];
+
+        return diff == 0;
+    }
+
+    bool Controller::checkSignedToken(Session *session, const char *token, time_t now)
+    {
+        if (strlen(token) > SIGNED_TOKEN_SIZE)
+            return false;
+
+        // Split from the right, as role names may hold dots
+        const char *signature = strrchr(token, '.') + 1;
+        if (strlen(signature) != SIGNATURE_SIZE * 2)
+            return false;
+
+        const char *generation = signature - 1;
+        while (generation > token && generation[-1] != '.')
+            generation--;
+
+        const char *issuedAt = generation - 1;
+        while (issuedAt > token && issuedAt[-1] != '.')
+            issuedAt--;
+
+        if (issuedAt == token || generation == signature - 1)
+            return false;
+
+        // Tokens of older generations were revoked and the ones of another role predate a role change
+        char *end;
+        if (strtoul(generation, &end, 10) != session->Generation || end != signature - 1)
+            return false;
+
+        // Tokens expire, unless the clock is behind the time they were issued at, as before it is synced
+        long long issued = strtoll(issuedAt, &end, 10);
+        if (end != generation - 1 || now - issued > SIGNED_TOKEN_MAX_AGE)
+            return false;
+
+        size_t length = issuedAt - 1 - token;
+        if (strlen(session->Role) != length || strncmp(token, session->Role, length))
+            return false;
+
+        char expected[SIGNATURE_SIZE * 2 + 1];
+        this->sign(session->Name, token, signature - token, expected);
+
+        // Compare the whole signature, so the time taken does not tell how much of it matched
+        uint8_t diff = 0;
+        for (int i = 0; i < SIGNATURE_SIZE * 2; i++)
+            diff |= expected[i] ^ signature[i];
+
+        return diff == 0;
+    }
+
+    Controller::Session *Controller::findSession(const char *name, uint32_t hash)
+    {
+        for (Session *session = this->sessions[hash % SESSION_BUCKETS]; session != NULL; session = session->Next)
+            if (session->Hash == hash && !strcmp(session->Name, name))
+                return session;
+
+        return NULL;
+    }
+
+    void Controller::loadSession(User *user)
+    {
+        uint32_t hash = database::Pool::Hash(user->Name);
+
+        Session *session = this->findSession(user->Name, hash);
+        if (session == NULL)
+        {
+            session = new Session();
+            strncpy(session->Name, user->Name, NVS_KEY_NAME_MAX_SIZE - 1);
+            session->Name[NVS_KEY_NAME_MAX_SIZE - 1] = '\0';
+            session->Hash = hash;
+            session->Next = this->sessions[hash % SESSION_BUCKETS];
+            this->sessions[hash % SESSION_BUCKETS] = session;
+        }
+
+        // Users without a token are logged out, though their signed tokens can still be valid
+        session->Active = user->Token != NULL && user->Token[0] != '\0';
+        if (session->Active)
+            digestToken(user->Token, session->Digest);
+
+        session->Role = database::Pool::Intern(user->Role);
+        session->Generation = user->Generation;
+    }
+
+    void Controller::removeSession(const char *name)
+    {
+        Session **link = &this->sessions[database::Pool::Hash(name) % SESSION_BUCKETS];
+        while (*link != NULL && strcmp((*link)->Name, name))
+            link = &(*link)->Next;
+
+        if (*link == NULL)
+            return;
+
+        Session *session = *link;
+        *link = session->Next;
+        delete session;
+    }
+
     uint32_t Controller::Count()
     {
         uint32_t count;
@@ -126,6 +366,11 @@ namespace user
         return count;
     }
 
+    uint32_t Controller::Generation()
+    {
+        return this->db->Generation();
+    }
+
     User *Controller::Get(const char *name)
     {
         User *user = NULL;
@@ -141,6 +386,33 @@ namespace user
         return user;
     }
 
+    User *Controller::Authenticate(const char *name, const char *token, time_t now)
+    {
+        User *user = NULL;
+
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+
+        // Signed tokens are the only ones holding dots
+        Session *session = this->findSession(name, database::Pool::Hash(name));
+        if (session != NULL && (strchr(token, '.') != NULL ? this->checkSignedToken(session, token, now) : this->checkToken(session, token)))
+        {
+            user = new User();
+            user->Name = strdup(session->Name);
+            user->Role = session->Role;
+            user->Generation = session->Generation;
+        }
+
+        xSemaphoreGive(this->lock);
+
+        return user;
+    }
+
+    void Controller::IssueToken(User *user, time_t issuedAt, char token[SIGNED_TOKEN_SIZE + 1])
+    {
+        int length = snprintf(token, SIGNED_TOKEN_SIZE + 1, "%s.%lld.%lu.", user->Role, (long long)issuedAt, (unsigned long)user->Generation);
+        this->sign(user->Name, token, length, token + length);
+    }
+
     bool Controller::ExistsWithRole(const char *role)
     {
         typedef struct findArgs
@@ -154,22 +426,17 @@ namespace user
             .role = role,
         };
 
-        ESP_ERROR_CHECK(this->db->Find(
-            [](const char *key, void *funcArgs) -> bool
+        ESP_ERROR_CHECK(this->db->Scan(
+            [](const char *key, cJSON *userJSON, void *funcArgs) -> bool
             {
                 findArgs *args = (findArgs *)funcArgs;
 
-                cJSON *userJSON = NULL;
-                ESP_ERROR_CHECK(Instance->db->Get(key, &userJSON));
-
                 if (!strcmp(cJSON_GetObjectItem(userJSON, "role")->valuestring, args->role))
                 {
                     args->exists = true;
-                    cJSON_Delete(userJSON);
                     return true;
                 }
 
-                cJSON_Delete(userJSON);
                 return false;
             },
             &args));
@@ -177,33 +444,79 @@ namespace user
         return args.exists;
     }
 
-    User *Controller::List(uint32_t *size)
+    void Controller::List(database::ResultSet<User> *users)
     {
-        uint32_t count = this->Count();
-        *size = count;
-        if (count < 1)
-            return NULL;
+        // Size the result set for the current records, ones added meanwhile just grow it
+        users->Reserve(this->Count());
+
+        ESP_ERROR_CHECK(this->db->Scan(
+            [](const char *key, cJSON *userJSON, void *context) -> bool
+            {
+                ((database::ResultSet<User> *)context)->Add(userJSON);
+                return false;
+            },
+            users));
+    }
 
-        User *list = new User[count];
-        User *aux = list;
+    void Controller::List(database::ResultSet<User> *users, uint32_t limit, database::Cursor *cursor)
+    {
+        // Pages are bounded, so they are allocated upfront
+        users->Reserve(limit);
 
-        ESP_ERROR_CHECK(this->db->Find(
-            [](const char *key, void *context) -> bool
+        ESP_ERROR_CHECK(this->db->Scan(
+            [](const char *key, cJSON *userJSON, void *context) -> bool
             {
-                User *list = *(User **)context;
+                ((database::ResultSet<User> *)context)->Add(userJSON);
+                return false;
+            },
+            users, limit, cursor));
+    }
 
-                cJSON *userJSON = NULL;
-                ESP_ERROR_CHECK(Instance->db->Get(key, &userJSON));
+    typedef struct listArgs
+    {
+        user_list_cb_t list;
+        void *context;
+        database::Arena *arena;
+    } listArgs;
 
-                *list = User(userJSON);
-                (*(User **)context)++;
+    void Controller::List(user_list_cb_t list, void *context)
+    {
+        // Users are built one at a time, reusing the same arena
+        database::Arena arena;
+        listArgs args = {list, context, &arena};
+
+        ESP_ERROR_CHECK(this->db->Scan(
+            [](const char *key, cJSON *userJSON, void *context) -> bool
+            {
+                listArgs *args = (listArgs *)context;
+
+                User *user = new (args->arena->Allocate(sizeof(User))) User(userJSON, args->arena);
+                args->list(user, args->context);
+                args->arena->Reset();
 
-                cJSON_Delete(userJSON);
                 return false;
             },
-            &aux));
+            &args));
+    }
+
+    void Controller::List(user_list_cb_t list, void *context, uint32_t limit, database::Cursor *cursor)
+    {
+        // Users are built one at a time, reusing the same arena
+        database::Arena arena;
+        listArgs args = {list, context, &arena};
 
-        return list;
+        ESP_ERROR_CHECK(this->db->Scan(
+            [](const char *key, cJSON *userJSON, void *context) -> bool
+            {
+                listArgs *args = (listArgs *)context;
+
+                User *user = new (args->arena->Allocate(sizeof(User))) User(userJSON, args->arena);
+                args->list(user, args->context);
+                args->arena->Reset();
+
+                return false;
+            },
+            &args, limit, cursor));
     }
 
     void Controller::Set(User *user)
@@ -211,16 +524,30 @@ namespace user
         cJSON *userJSON = user->JSON();
         ESP_ERROR_CHECK(this->db->Set(user->Name, userJSON));
         cJSON_Delete(userJSON);
+
+        // Logins, logouts and role changes are all saved through here
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+        this->loadSession(user);
+        xSemaphoreGive(this->lock);
     }
 
     void Controller::Delete(const char *name)
     {
         ESP_ERROR_CHECK(this->db->Delete(name));
+
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+        this->removeSession(name);
+        xSemaphoreGive(this->lock);
     }
 
     void Controller::Drop()
     {
+        xSemaphoreTake(this->lock, portMAX_DELAY);
+        for (int i = 0; i < SESSION_BUCKETS; i++)
+            while (this->sessions[i] != NULL)
+                this->removeSession(this->sessions[i]->Name);
         ESP_ERROR_CHECK(this->db->Drop());
+        xSemaphoreGive(this->lock);
     }
 
     void Controller::GenerateToken(char *token)
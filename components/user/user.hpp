@@ -1,5 +1,8 @@
 #pragma once
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "nvs.h"
 #include "cJSON.h"
 #include "logger.hpp"
 #include "role.hpp"
@@ -10,10 +13,33 @@ namespace user
     static const char *TAG = "user";
 
     static const char *DB_NAMESPACE = "user";
+    static const uint32_t DB_CACHE_SIZE = 4 * 1024; // Bytes
     static const uint8_t TOKEN_SIZE = 16;
     static const char *TOKEN_CHARSET = "0123456789abcdefghijklmnopqrstuvwxyz";
     static const uint8_t PASSWORD_HASH_SIZE = 128;
     static const char *PASSWORD_HASH_CHARSET = "0123456789abcdef";
+    static const uint8_t TOKEN_DIGEST_SIZE = 32; // SHA-256
+    static const uint8_t SESSION_BUCKETS = 16;
+
+    // Signed tokens are "<role>.<issued at>.<generation>.<signature>", checked without reading the user
+    static const uint8_t SIGNATURE_SIZE = 32; // HMAC-SHA256
+    static const uint8_t SIGNED_TOKEN_SIZE = (NVS_KEY_NAME_MAX_SIZE - 1) + 1 + 20 + 1 + 10 + 1 + SIGNATURE_SIZE * 2; // Max, '\0' excluded
+    static const uint8_t HMAC_BLOCK_SIZE = 64;
+    static const time_t SIGNED_TOKEN_MAX_AGE = 30 * 24 * 60 * 60; // Seconds
+    static const uint8_t SECRET_SIZE = 32;
+    static const char *SECRET_PARTITION = "nvs_keys";
+    static const uint32_t SECRET_OFFSET = 2 * 1024; // Past the NVS encryption keys at the start of the partition
+
+    static const database::Field DB_FIELDS[] = {
+        {"name", database::FIELD_STRING},
+        {"password", database::FIELD_STRING},
+        {"token", database::FIELD_STRING},
+        {"role", database::FIELD_STRING},
+        {"emoji", database::FIELD_STRING},
+        {"created_at", database::FIELD_NUMBER},
+        {"generation", database::FIELD_NUMBER},
+    };
+    static const database::Schema DB_SCHEMA = {2, DB_FIELDS, sizeof(DB_FIELDS) / sizeof(database::Field)};
 
     class User
     {
@@ -21,17 +47,20 @@ namespace user
         const char *Name;
         const char *Password;
         const char *Token;
-        const char *Role;
+        const char *Role; // Interned
         const char *Emoji;
         time_t CreatedAt;
+        uint32_t Generation; // Of the signed tokens of the user, bumped to revoke them
 
     public:
         User();
         User(const char *name, const char *password, const char *token,
              const char *role, const char *emoji, time_t createdAt);
-        User(cJSON *src);
+        User(cJSON *src, database::Arena *arena = NULL); // Strings are copied from src, to the arena when given
+        User(User &&other);
         ~User();
         User &operator=(const User &other);
+        User &operator=(User &&other);
         cJSON *JSON();
         bool Equals(const char *name) const;
         bool Equals(User *other) const;
@@ -43,11 +72,40 @@ namespace user
         static const User System = {"System", "", "", "Admin", "🤖", 0};
     }
 
+    // Receives each listed user, which is only valid during the call
+    typedef void (*user_list_cb_t)(User *user, void *context);
+
     class Controller
     {
     private:
+        // Logged in user, so authenticating a request does not read the user
+        class Session
+        {
+        public:
+            char Name[NVS_KEY_NAME_MAX_SIZE];
+            uint32_t Hash;  // Of the name
+            bool Active;    // Whether the user holds a token, users without one are logged out
+            uint8_t Digest[TOKEN_DIGEST_SIZE]; // Of the token
+            const char *Role;    // Interned
+            uint32_t Generation; // Of the signed tokens of the user
+            Session *Next;
+        };
+
         logger::Logger *logger;
         database::Handle *db;
+        SemaphoreHandle_t lock;
+        Session *sessions[SESSION_BUCKETS];
+        uint8_t secret[SECRET_SIZE]; // Of the signed tokens
+
+    private:
+        static void digestToken(const char *token, uint8_t digest[TOKEN_DIGEST_SIZE]);
+        void loadSecret();
+        void sign(const char *name, const char *claims, size_t length, char signature[SIGNATURE_SIZE * 2 + 1]);
+        bool checkToken(Session *session, const char *token);
+        bool checkSignedToken(Session *session, const char *token, time_t now);
+        Session *findSession(const char *name, uint32_t hash);
+        void loadSession(User *user);
+        void removeSession(const char *name);
 
     public:
         inline static Controller *Instance;
@@ -55,9 +113,15 @@ namespace user
 
     public:
         uint32_t Count();
+        uint32_t Generation(); // Bumped whenever the records change
         User *Get(const char *name);
+        User *Authenticate(const char *name, const char *token, time_t now); // Only with name and role, NULL if the token is invalid
+        void IssueToken(User *user, time_t issuedAt, char token[SIGNED_TOKEN_SIZE + 1]);
         bool ExistsWithRole(const char *role);
-        User *List(uint32_t *size);
+        void List(database::ResultSet<User> *users);
+        void List(database::ResultSet<User> *users, uint32_t limit, database::Cursor *cursor);
+        void List(user_list_cb_t list, void *context);
+        void List(user_list_cb_t list, void *context, uint32_t limit, database::Cursor *cursor);
         void Set(User *user);
         void Delete(const char *name);
         void Drop();
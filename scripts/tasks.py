@@ -1,3 +1,8 @@
+import http.client
+import json
+import statistics
+import time
+
 from matplotlib import animation, pyplot
 from multiprocessing import cpu_count
 from superinvoke import task
@@ -56,3 +61,66 @@ def erase(context, yes=False):
         context.exit()
 
     context.run(f"{Tools.Idf} erase-flash")
+
+
+@task()
+def bench(context, target="linux", port="/dev/ttyACM0", yes=False):
+    """Build and run the benchmark app, on the host or on a unit, entity suites only run on a unit."""
+    if target == "linux":
+        context.run(f"{Tools.Idf} -C bench -B bench/build --preview set-target linux")
+        context.run(f"{Tools.Idf} -C bench -B bench/build build")
+        context.run("bench/build/bench.elf")
+        return
+
+    context.print(f"The unit firmware will be replaced and its database [bold red1]dropped[/bold red1]")
+
+    if not yes and context.input("Continue? y/N: ").lower() != "y":
+        context.exit()
+
+    context.run(f"{Tools.Idf} -C bench -B bench/build set-target {target}")
+    context.run(f"{Tools.Idf} -C bench -B bench/build -p {port} build flash monitor")
+
+
+@task()
+def latency(context, host, name, password, uri="/api/devices", requests=200, signed=False):
+    """Measure the latency of an authenticated API request on a unit."""
+    connection = http.client.HTTPConnection(host, timeout=10)
+
+    connection.request(
+        "POST",
+        "/api/login",
+        body=json.dumps({"name": name, "password": password}),
+        headers={"Content-Type": "application/json"},
+    )
+    response = connection.getresponse()
+    user = json.loads(response.read())
+    if response.status != 200:
+        context.print(f"[bold red1]Cannot login: {response.status} {user}[/bold red1]")
+        context.exit()
+
+    # Session tokens are checked against the session table, signed ones by their signature
+    token = user["access_token"] if signed else user["token"]
+    headers = {"Authorization": f"{name}:{token}"}
+
+    # The connection is kept alive, so only the request itself is measured
+    latencies = []
+    for _ in range(requests):
+        start = time.perf_counter()
+        connection.request("GET", uri, headers=headers)
+        response = connection.getresponse()
+        response.read()
+        latencies.append((time.perf_counter() - start) * 1000)
+
+        if response.status != 200:
+            context.print(f"[bold red1]Cannot GET {uri}: {response.status}[/bold red1]")
+            context.exit()
+
+    connection.close()
+
+    latencies.sort()
+    percentile = lambda p: latencies[min(len(latencies) - 1, (len(latencies) * p + 99) // 100 - 1)]
+    context.print(
+        f"GET {uri} x{requests}: "
+        f"mean={statistics.mean(latencies):.1f} p50={percentile(50):.1f} p90={percentile(90):.1f} "
+        f"p99={percentile(99):.1f} max={latencies[-1]:.1f} ms"
+    )